@@ -0,0 +1,385 @@
+#include "blockcodec.h"
+#include "compressedids.h"
+#include "error.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__SSE2__) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define DECODE_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+
+/* Vectorized decoders process up to groupsNo groups of four deltas, stopping
+ * before group that could not be loaded without reading past end. Return
+ * number of decoded groups, data and val are advanced. */
+typedef size_t (*DecodeFunc)(const uint8_t *ctrl, size_t groupsNo,
+		const uint8_t *&data, const uint8_t *end, uint32_t *out,
+		uint32_t &val);
+
+struct GroupTables
+{
+	// data length of four deltas and mask gathering them to 32-bit lanes,
+	// both indexed by control byte
+	uint8_t lengths[256];
+	uint8_t shuffle[256][16];
+};
+
+static GroupTables makeGroupTables()
+{
+	GroupTables tables;
+
+	for (unsigned ctrl = 0; ctrl < 256; ctrl++)
+	{
+		unsigned pos = 0;
+
+		for (unsigned lane = 0; lane < 4; lane++)
+		{
+			unsigned len = ((ctrl >> (2 * lane)) & 3) + 1;
+
+			for (unsigned byte = 0; byte < 4; byte++)
+				tables.shuffle[ctrl][4 * lane + byte] =
+					byte < len ? pos + byte : 0x80;
+
+			pos += len;
+		}
+
+		tables.lengths[ctrl] = pos;
+	}
+
+	return tables;
+}
+
+static const GroupTables groupTables = makeGroupTables();
+
+
+static inline unsigned deltaSize(const uint8_t *ctrl, size_t delta)
+{
+	return ((ctrl[delta / 4] >> (2 * (delta % 4))) & 3) + 1;
+}
+
+static size_t dataSize(const uint8_t *ctrl, size_t deltasNo)
+{
+	size_t size = 0;
+	size_t groupsNo = deltasNo / 4;
+
+	for (size_t i = 0; i < groupsNo; i++)
+		size += groupTables.lengths[ctrl[i]];
+
+	for (size_t i = groupsNo * 4; i < deltasNo; i++)
+		size += deltaSize(ctrl, i);
+
+	return size;
+}
+
+static void decodeScalar(const uint8_t *ctrl, size_t first, size_t deltasNo,
+		const uint8_t *&data, uint32_t *out, uint32_t &val)
+{
+	for (size_t i = first; i < deltasNo; i++)
+	{
+		unsigned len = deltaSize(ctrl, i);
+		uint32_t delta = 0;
+
+		for (unsigned byte = 0; byte < len; byte++)
+			delta |= (uint32_t) data[byte] << (8 * byte);
+
+		data += len;
+		val += delta;
+		out[i] = val;
+	}
+}
+
+#ifdef DECODE_SIMD
+
+__attribute__((target("ssse3")))
+static size_t decodeSsse3(const uint8_t *ctrl, size_t groupsNo,
+		const uint8_t *&data, const uint8_t *end, uint32_t *out,
+		uint32_t &val)
+{
+	__m128i prev = _mm_set1_epi32(val);
+	size_t i;
+
+	for (i = 0; i < groupsNo && end - data >= 16; i++)
+	{
+		uint8_t c = ctrl[i];
+		__m128i mask = _mm_loadu_si128(
+				(const __m128i*) groupTables.shuffle[c]);
+		__m128i v = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i*) data), mask);
+
+		// prefix sum of deltas
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi32(v, prev);
+
+		_mm_storeu_si128((__m128i*) (out + 4 * i), v);
+		prev = _mm_shuffle_epi32(v, 0xff);
+		data += groupTables.lengths[c];
+	}
+
+	val = _mm_cvtsi128_si32(prev);
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decodeAvx2(const uint8_t *ctrl, size_t groupsNo,
+		const uint8_t *&data, const uint8_t *end, uint32_t *out,
+		uint32_t &val)
+{
+	const __m256i lastLane = _mm256_set1_epi32(7);
+	const __m256i lastLowLane = _mm256_set1_epi32(3);
+	__m256i prev = _mm256_set1_epi32(val);
+	size_t i;
+
+	// two groups at once, one per 128-bit lane
+	for (i = 0; i + 2 <= groupsNo; i += 2)
+	{
+		uint8_t c0 = ctrl[i];
+		uint8_t c1 = ctrl[i + 1];
+		size_t len0 = groupTables.lengths[c0];
+
+		if (end - data < (ptrdiff_t) len0 + 16)
+			break;
+
+		__m256i src = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i*) data)),
+				_mm_loadu_si128((const __m128i*) (data + len0)), 1);
+		__m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(
+					_mm_loadu_si128((const __m128i*) groupTables.shuffle[c0])),
+				_mm_loadu_si128((const __m128i*) groupTables.shuffle[c1]), 1);
+		__m256i v = _mm256_shuffle_epi8(src, mask);
+
+		// prefix sum within lanes, then the high one is carried on
+		v = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+		v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+		__m256i carry = _mm256_permutevar8x32_epi32(v, lastLowLane);
+		v = _mm256_add_epi32(v, _mm256_blend_epi32(_mm256_setzero_si256(),
+					carry, 0xf0));
+		v = _mm256_add_epi32(v, prev);
+
+		_mm256_storeu_si256((__m256i*) (out + 4 * i), v);
+		prev = _mm256_permutevar8x32_epi32(v, lastLane);
+		data += len0 + groupTables.lengths[c1];
+	}
+
+	val = _mm_cvtsi128_si32(_mm256_castsi256_si128(prev));
+	return i;
+}
+
+static DecodeFunc selectDecodeFunc()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return decodeAvx2;
+	if (__builtin_cpu_supports("ssse3"))
+		return decodeSsse3;
+
+	return NULL;
+}
+
+static const DecodeFunc decodeVector = selectDecodeFunc();
+
+#else
+
+static const DecodeFunc decodeVector = NULL;
+
+#endif
+
+
+// flag in deltas number byte
+#define BLOCK_BITMAP	0x80
+
+static inline unsigned encodedSize(uint32_t delta)
+{
+	return delta < 0x100 ? 1 : delta < 0x10000 ? 2 : delta < 0x1000000 ? 3 : 4;
+}
+
+static inline unsigned lowestBit(uint64_t word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	unsigned bit = 0;
+	while (!(word & 1))
+	{
+		word >>= 1;
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+static void decodeBitmap(const uint8_t *bits, size_t size, size_t deltasNo,
+		uint32_t *out, uint32_t val)
+{
+	size_t no = 0;
+
+	for (size_t pos = 0; pos < size; pos += 8)
+	{
+		uint64_t word = 0;
+		for (size_t byte = 0; byte < 8 && pos + byte < size; byte++)
+			word |= (uint64_t) bits[pos + byte] << (8 * byte);
+
+		for (; word; word &= word - 1)
+		{
+			if (no >= deltasNo)
+				throw FuncError("malformed database, inconsistent block bitmap");
+
+			out[no++] = val + 1 + 8 * pos + lowestBit(word);
+		}
+	}
+
+	if (no != deltasNo)
+		throw FuncError("malformed database, inconsistent block bitmap");
+}
+
+void encodeIdsBlocks(const uint32_t *ids, size_t no, uint32_t base,
+		vector<uint8_t> &out)
+{
+	uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+
+	for (size_t pos = 0; pos < no; pos += IDS_BLOCK_SIZE)
+	{
+		size_t deltasNo = min(no - pos, (size_t) IDS_BLOCK_SIZE) - 1;
+		const uint32_t *block = ids + pos;
+
+		uint32_t span = block[deltasNo] - block[0];
+		size_t ctrlSize = (deltasNo + 3) / 4;
+		size_t size = ctrlSize;
+		for (size_t i = 0; i < deltasNo; i++)
+			size += encodedSize(block[i + 1] - block[i]);
+
+		// dense IDs are cheaper as bitmap of range following the first one
+		size_t bitmapSize = ((size_t) span + 7) / 8;
+		bool bitmap = bitmapSize < size;
+
+		size_t headSize = CompressedIds::encodeDelta(block[0] - base, head);
+		out.insert(out.end(), head, head + headSize);
+		out.push_back(deltasNo | (bitmap ? BLOCK_BITMAP : 0));
+
+		headSize = CompressedIds::encodeDelta(span, head);
+		out.insert(out.end(), head, head + headSize);
+		headSize = CompressedIds::encodeDelta(bitmap ? bitmapSize : size, head);
+		out.insert(out.end(), head, head + headSize);
+
+		if (bitmap)
+		{
+			size_t bitsPos = out.size();
+			out.resize(bitsPos + bitmapSize, 0);
+
+			for (size_t i = 1; i <= deltasNo; i++)
+			{
+				uint32_t bit = block[i] - block[0] - 1;
+				out[bitsPos + bit / 8] |= 1 << (bit % 8);
+			}
+
+			base = block[deltasNo];
+			continue;
+		}
+
+		size_t ctrlPos = out.size();
+		out.resize(ctrlPos + ctrlSize, 0);
+
+		for (size_t i = 0; i < deltasNo; i++)
+		{
+			uint32_t delta = block[i + 1] - block[i];
+			unsigned len = encodedSize(delta);
+
+			out[ctrlPos + i / 4] |= (len - 1) << (2 * (i % 4));
+
+			for (unsigned byte = 0; byte < len; byte++)
+				out.push_back(delta >> (8 * byte));
+		}
+
+		base = block[deltasNo];
+	}
+}
+
+struct BlockHeader
+{
+	uint32_t delta;
+	size_t deltasNo;
+	bool bitmap;
+	uint32_t span;
+	uint32_t size;
+};
+
+static const uint8_t *readBlockHeader(const uint8_t *data, const uint8_t *end,
+		BlockHeader &header)
+{
+	data += CompressedIds::decodeDelta(data, end - data, header.delta);
+
+	if (data >= end || (*data & ~BLOCK_BITMAP) >= IDS_BLOCK_SIZE)
+		throw FuncError("malformed database, invalid block header");
+
+	header.deltasNo = *data & ~BLOCK_BITMAP;
+	header.bitmap = *data & BLOCK_BITMAP;
+	data++;
+
+	data += CompressedIds::decodeDelta(data, end - data, header.span);
+	data += CompressedIds::decodeDelta(data, end - data, header.size);
+
+	if ((size_t) (end - data) < header.size)
+		throw FuncError("malformed database, incomplete block data");
+
+	if (header.bitmap && header.size != ((size_t) header.span + 7) / 8)
+		throw FuncError("malformed database, inconsistent block size");
+
+	return data;
+}
+
+const uint8_t *decodeIdsBlock(const uint8_t *data, const uint8_t *end,
+		uint32_t *out, size_t &no, uint32_t &val)
+{
+	BlockHeader header;
+	data = readBlockHeader(data, end, header);
+
+	val += header.delta;
+	out[0] = val;
+	no = header.deltasNo + 1;
+
+	if (header.bitmap)
+	{
+		decodeBitmap(data, header.size, header.deltasNo, out + 1, val);
+		if (out[header.deltasNo] - val != header.span)
+			throw FuncError("malformed database, inconsistent block span");
+
+		val = out[header.deltasNo];
+		return data + header.size;
+	}
+
+	const uint8_t *ctrl = data;
+	const uint8_t *next = data + header.size;
+	data += (header.deltasNo + 3) / 4;
+
+	if (data > next || dataSize(ctrl, header.deltasNo) != (size_t) (next - data))
+		throw FuncError("malformed database, inconsistent block size");
+
+	uint32_t first = val;
+	out++;
+
+	size_t groupsNo = 0;
+	if (decodeVector)
+		groupsNo = decodeVector(ctrl, header.deltasNo / 4, data, end, out, val);
+
+	decodeScalar(ctrl, groupsNo * 4, header.deltasNo, data, out, val);
+
+	if (val - first != header.span)
+		throw FuncError("malformed database, inconsistent block span");
+
+	return next;
+}
+
+const uint8_t *skipIdsBlock(const uint8_t *data, const uint8_t *end,
+		uint32_t val, IdsBlockSkip &skip)
+{
+	BlockHeader header;
+	data = readBlockHeader(data, end, header);
+
+	skip.firstId = val + header.delta;
+	skip.lastId = skip.firstId + header.span;
+	skip.bitmap = header.bitmap ? data : NULL;
+	return data + header.size;
+}
@@ -0,0 +1,55 @@
+#ifndef __BLOCK_CODEC_H__
+#define __BLOCK_CODEC_H__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+/* Block format of IDs lists, alternative to CompressedIds varint deltas.
+ * List is a sequence of blocks of up to IDS_BLOCK_SIZE IDs, every block is:
+ *  - the first delta, encoded as CompressedIds::encodeDelta, so list head is
+ *    re-based the same way in both formats,
+ *  - number of following deltas (single byte), the highest bit marks bitmap
+ *    block,
+ *  - span of block IDs (last - first) and size of the rest of block, both
+ *    encoded as CompressedIds::encodeDelta, they let blocks be skipped
+ *    without decoding,
+ *  - control bytes, each one holding lengths of four deltas (2 bits per
+ *    delta, length - 1),
+ *  - deltas data, 1 to 4 bytes each, little endian (as Stream VByte).
+ * Block of dense IDs is stored as bitmap instead, whichever is smaller (as
+ * Roaring containers): bit n of byte b marks ID first + 8 * b + n + 1, span
+ * determines bitmap size.
+ * The first delta of block is relative to the last ID of preceding block, so
+ * lists are concatenated without re-encoding. Blocks are decoded using
+ * SSSE3/AVX2 when available. */
+#define IDS_BLOCK_SIZE	128
+
+/** Append IDs encoded in blocks to out, the first one is relative to base.
+ * IDs must be ascending, only the first one could be equal to base. */
+void encodeIdsBlocks(const uint32_t *ids, size_t no, uint32_t base,
+		std::vector<uint8_t> &out);
+
+/** Decode block starting at data, list ends at end. Up to IDS_BLOCK_SIZE IDs
+ * are stored to out and their number to no. val is the last ID of preceding
+ * block and is updated. Returns beginning of the next block. */
+const uint8_t *decodeIdsBlock(const uint8_t *data, const uint8_t *end,
+		uint32_t *out, size_t &no, uint32_t &val);
+
+/* Entry of skip table, built from block headers */
+struct IdsBlockSkip
+{
+	uint32_t firstId;
+	uint32_t lastId;
+	size_t offset;			// from the beginning of list
+	const uint8_t *bitmap;	// in list data, NULL for deltas block
+};
+
+/** Read header of block starting at data without decoding it, val is the last
+ * ID of preceding block. Range and bitmap of block are stored to skip, its
+ * offset is left untouched. Returns beginning of the next block. */
+const uint8_t *skipIdsBlock(const uint8_t *data, const uint8_t *end,
+		uint32_t val, IdsBlockSkip &skip);
+
+#endif
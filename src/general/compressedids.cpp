@@ -1,5 +1,6 @@
 #include "compressedids.h"
 #include "error.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -8,13 +9,18 @@ using namespace std;
 
 /*** CompressedIds ***/
 
+const size_t CompressedIds::MAX_DELTA_SIZE;
+
 CompressedIds::CompressedIds()
-	: m_lastId(0), m_lastDelta((uint32_t) -1)
+	: m_view(NULL), m_viewSize(0), m_lastId(0), m_format(VARINT),
+	m_lastDelta((uint32_t) -1)
 {}
 
 unsigned CompressedIds::add(uint32_t id)
 {
 	unsigned added = 0;
+	assert(m_format == VARINT);
+	detachView();
 
 	if (m_lastId == (uint32_t) -1)
 		m_lastId = lastId();
@@ -30,45 +36,23 @@ unsigned CompressedIds::add(uint32_t id)
 
 		if ((m_lastDelta != (uint32_t) -1) && (delta == m_lastDelta))
 		{
-			if (!m_ids.empty() && m_ids.back() >= 0x40 && m_ids.back() < 0x7f)
-			{
-				m_ids.back()++;
-			}
-			else
-			{
-				m_ids.push_back(0x41);
-				added = 1;
-			}
+			uint8_t rep;
+			added = encodeRepeat(m_ids.back(), &rep);
+
+			if (added > 0)
+				m_ids.push_back(rep);
 
 			m_lastId = id;
 		}
 		else
 		{
-			if (delta >> 27)
-			{
-				m_ids.push_back(((delta >> 27) & 0x7f) | 0x80);
-				added++;
-			}
-			if (delta >> 20)
-			{
-				m_ids.push_back(((delta >> 20) & 0x7f) | 0x80);
-				added++;
-			}
-			if (delta >> 13)
-			{
-				m_ids.push_back(((delta >> 13) & 0x7f) | 0x80);
-				added++;
-			}
-			if (delta >> 6)
-			{
-				m_ids.push_back(((delta >> 6)  & 0x7f) | 0x80);
-				added++;
-			}
-			m_ids.push_back(delta & 0x3f);
-			added++;
+			uint8_t data[MAX_DELTA_SIZE];
+			added = encodeDelta(delta, data);
+			m_ids.insert(m_ids.end(), data, data + added);
 
+			// never repeat the first delta - it is relative to the list base
+			m_lastDelta = m_ids.size() == added ? 0 : delta;
 			m_lastId = id;
-			m_lastDelta = delta;
 		}
 	}
 
@@ -78,38 +62,57 @@ unsigned CompressedIds::add(uint32_t id)
 void CompressedIds::clear()
 {
 	m_ids.clear();
+	m_view = NULL;
+	m_viewSize = 0;
 	m_lastId = 0;
 	m_lastDelta = (uint32_t) -1;
+	m_skips.clear();
 }
 
 size_t CompressedIds::size() const
 {
-	return m_ids.size();
+	return m_view ? m_viewSize : m_ids.size();
 }
 
 bool CompressedIds::empty() const
 {
-	return m_ids.empty();
+	return size() == 0;
 }
 
 void CompressedIds::swap(CompressedIds &ids)
 {
 	m_ids.swap(ids.m_ids);
+	SWAP_VAL(m_view, ids.m_view);
+	SWAP_VAL(m_viewSize, ids.m_viewSize);
 	SWAP_VAL(m_lastId, ids.m_lastId);
+	SWAP_VAL(m_format, ids.m_format);
 	SWAP_VAL(m_lastDelta, ids.m_lastDelta);
+	m_skips.swap(ids.m_skips);
 }
 
 void CompressedIds::move(CompressedIds &ids)
 {
 	m_lastId = ids.m_lastId;
 	m_lastDelta = ids.m_lastDelta;
+	m_format = ids.m_format;
+	m_view = ids.m_view;
+	m_viewSize = ids.m_viewSize;
 
 	m_ids.swap(ids.m_ids);
+	m_skips.swap(ids.m_skips);
 	ids.clear();
 }
 
 bool CompressedIds::hasId(uint32_t id) const
 {
+	if (m_format == BLOCKS)
+	{
+		Ids ids;
+		ids.add(id);
+		commonPart(ids);
+		return !ids.empty();
+	}
+
 	for (iterator it = begin(); !it.end(); ++it)
 	{
 		if (*it == id)
@@ -123,19 +126,153 @@ bool CompressedIds::hasId(uint32_t id) const
 
 void CompressedIds::decompress(Ids &ids) const
 {
+	if (m_format == BLOCKS && ids.empty())
+	{
+		// bitmap blocks take less than a byte per ID, so room is made for
+		// every block
+		const uint8_t *data = getData();
+		const uint8_t *end = data + size();
+		size_t room = size() + IDS_BLOCK_SIZE;
+		uint32_t *out = ids.setData(room);
+		size_t no = 0;
+		uint32_t val = 0;
+
+		while (data < end)
+		{
+			if (no + IDS_BLOCK_SIZE > room)
+			{
+				room *= 2;
+				out = ids.setData(room);
+			}
+
+			size_t blockNo;
+			data = decodeIdsBlock(data, end, out + no, blockNo, val);
+			no += blockNo;
+		}
+
+		ids.setData(no);
+		return;
+	}
+
 	for (iterator it = begin(); !it.end(); ++it)
 		ids.add(*it);
 }
 
+// the first block with last ID not less than id, searched from pos
+static size_t gallopSkips(const vector<IdsBlockSkip> &skips, size_t pos,
+		uint32_t id)
+{
+	if (pos >= skips.size() || skips[pos].lastId >= id)
+		return pos;
+
+	size_t step = 1;
+	while (pos + step < skips.size() && skips[pos + step].lastId < id)
+	{
+		pos += step;
+		step *= 2;
+	}
+
+	auto first = skips.begin() + pos + 1;
+	auto last = skips.begin() + min(pos + step + 1, skips.size());
+	return lower_bound(first, last, id,
+			[](const IdsBlockSkip &skip, uint32_t id) {
+				return skip.lastId < id;
+			}) - skips.begin();
+}
+
 void CompressedIds::commonPart(Ids &ids) const
 {
-	Ids result;
-	for (iterator it = begin(); !it.end(); ++it)
+	// result is written over ids, it is never ahead of read position
+	size_t idsNo = ids.size();
+	uint32_t *res = ids.setData(idsNo);
+	size_t no = 0;
+
+	if (m_format == BLOCKS)
 	{
-		if (ids.hasId(*it) > 0)
-			result.add(*it);
+		const vector<IdsBlockSkip> &skips = getSkips();
+		const uint8_t *data = getData();
+		const uint8_t *end = data + size();
+
+		uint32_t block[IDS_BLOCK_SIZE];
+		size_t blockNo = 0, blockPos = 0;
+		size_t skip = 0, decoded = (size_t) -1;
+
+		for (size_t i = 0; i < idsNo; i++)
+		{
+			uint32_t id = res[i];
+
+			skip = gallopSkips(skips, skip, id);
+			if (skip >= skips.size())
+				break;
+
+			const IdsBlockSkip &range = skips[skip];
+			if (id < range.firstId)
+				continue;
+
+			// bitmap block is tested without decoding, its first ID has no bit
+			if (range.bitmap)
+			{
+				uint32_t bit = id - range.firstId - 1;
+				if (id == range.firstId ||
+						(range.bitmap[bit / 8] >> (bit % 8)) & 1)
+				{
+					res[no++] = id;
+				}
+
+				continue;
+			}
+
+			if (skip != decoded)
+			{
+				uint32_t val = skip ? skips[skip - 1].lastId : 0;
+				decodeIdsBlock(data + range.offset, end, block, blockNo, val);
+				decoded = skip;
+				blockPos = 0;
+			}
+
+			// block ends with ID not less than id
+			while (block[blockPos] < id)
+				blockPos++;
+
+			if (block[blockPos] == id)
+				res[no++] = id;
+		}
 	}
-	ids.swap(result);
+	else
+	{
+		iterator it = begin();
+
+		for (size_t i = 0; i < idsNo && !it.end(); i++)
+		{
+			while (!it.end() && *it < res[i])
+				++it;
+
+			if (!it.end() && *it == res[i])
+				res[no++] = res[i];
+		}
+	}
+
+	ids.setData(no);
+}
+
+void CompressedIds::excludeFrom(Ids &ids) const
+{
+	size_t idsNo = ids.size();
+	uint32_t *res = ids.setData(idsNo);
+	size_t no = 0;
+
+	iterator it = begin();
+
+	for (size_t i = 0; i < idsNo; i++)
+	{
+		while (!it.end() && *it < res[i])
+			++it;
+
+		if (it.end() || *it != res[i])
+			res[no++] = res[i];
+	}
+
+	ids.setData(no);
 }
 
 uint32_t CompressedIds::firstId() const
@@ -154,15 +291,24 @@ uint32_t CompressedIds::lastId() const
 	return lastId;
 }
 
+CompressedIds::Format CompressedIds::getFormat() const
+{
+	return m_format;
+}
+
 const uint8_t *CompressedIds::getData() const
 {
-	return m_ids.data();
+	return m_view ? m_view : m_ids.data();
 }
 
-uint8_t *CompressedIds::setData(size_t size, uint32_t lastId)
+uint8_t *CompressedIds::setData(size_t size, uint32_t lastId, Format format)
 {
 	m_lastId = lastId;
+	m_format = format;
 	m_lastDelta = (uint32_t) -1;
+	m_view = NULL;
+	m_viewSize = 0;
+	m_skips.clear();
 
 	m_ids.resize(size);
 	return m_ids.data();
@@ -170,8 +316,10 @@ uint8_t *CompressedIds::setData(size_t size, uint32_t lastId)
 
 uint8_t *CompressedIds::appendData(size_t size, uint32_t lastId)
 {
+	detachView();
 	m_lastId = lastId;
 	m_lastDelta = (uint32_t) -1;
+	m_skips.clear();
 
 	size_t pos = m_ids.size();
 	m_ids.resize(pos + size);
@@ -180,19 +328,153 @@ uint8_t *CompressedIds::appendData(size_t size, uint32_t lastId)
 
 void CompressedIds::validate() const
 {
-	if (!m_ids.empty())
+	const uint8_t *data = getData();
+	size_t len = size();
+
+	if (m_format == BLOCKS)
 	{
-		if ((m_ids.front() & 0xc0) == 0x40)
+		// blocks must fill the list exactly
+		const uint8_t *end = data + len;
+		IdsBlockSkip skip;
+		skip.lastId = 0;
+
+		while (data < end)
+			data = skipIdsBlock(data, end, skip.lastId, skip);
+	}
+	else if (len > 0)
+	{
+		if ((data[0] & 0xc0) == 0x40)
 			throw ThisError("malformed database, inconsistent chunk data");
 
-		if (m_ids.back() & 0x80)
+		if (data[len - 1] & 0x80)
 			throw ThisError("malformed database, incomplete chunk data");
 	}
 }
 
-void CompressedIds::clearChunk()
+void CompressedIds::setView(const uint8_t *data, size_t size, uint32_t lastId,
+		Format format)
 {
 	m_ids.clear();
+	m_view = data;
+	m_viewSize = size;
+	m_lastId = lastId;
+	m_format = format;
+	m_lastDelta = (uint32_t) -1;
+	m_skips.clear();
+}
+
+bool CompressedIds::isView() const
+{
+	return m_view != NULL;
+}
+
+void CompressedIds::detachView()
+{
+	if (m_view)
+	{
+		m_ids.assign(m_view, m_view + m_viewSize);
+		m_view = NULL;
+		m_viewSize = 0;
+	}
+}
+
+size_t CompressedIds::encodeDelta(uint32_t delta, uint8_t *data)
+{
+	size_t size = 0;
+
+	if (delta >> 27)
+		data[size++] = ((delta >> 27) & 0x7f) | 0x80;
+	if (delta >> 20)
+		data[size++] = ((delta >> 20) & 0x7f) | 0x80;
+	if (delta >> 13)
+		data[size++] = ((delta >> 13) & 0x7f) | 0x80;
+	if (delta >> 6)
+		data[size++] = ((delta >> 6)  & 0x7f) | 0x80;
+
+	data[size++] = delta & 0x3f;
+	return size;
+}
+
+size_t CompressedIds::encodeRepeat(uint8_t &last, uint8_t *data)
+{
+	// last byte of the list is either delta or repetition counter
+	if (last >= 0x40 && last < 0x7f)
+	{
+		last++;
+		return 0;
+	}
+
+	data[0] = 0x41;
+	return 1;
+}
+
+size_t CompressedIds::decodeDelta(const uint8_t *data, size_t size,
+		uint32_t &delta)
+{
+	if (size == 0 || (data[0] & 0xc0) == 0x40)
+		throw FuncError("malformed database, invalid delta encoding");
+
+	size_t pos = 0;
+	delta = 0;
+
+	while (data[pos] & 0x80)
+	{
+		delta <<= 7;
+		delta |= data[pos] & 0x7f;
+
+		if (++pos >= size)
+			throw FuncError("malformed database, incomplete delta encoding");
+	}
+
+	delta <<= 6;
+	delta |= data[pos] & 0x3f;
+	return pos + 1;
+}
+
+void CompressedIds::toBlocks(const uint8_t *data, size_t size,
+		vector<uint8_t> &out)
+{
+	uint32_t ids[IDS_BLOCK_SIZE];
+	size_t no = 0;
+	uint32_t base = 0;
+
+	out.clear();
+
+	for (iterator it(data, size); !it.end(); ++it)
+	{
+		ids[no++] = *it;
+
+		if (no == IDS_BLOCK_SIZE)
+		{
+			encodeIdsBlocks(ids, no, base, out);
+			base = ids[no - 1];
+			no = 0;
+		}
+	}
+
+	encodeIdsBlocks(ids, no, base, out);
+}
+
+const vector<IdsBlockSkip> &CompressedIds::getSkips() const
+{
+	if (m_skips.empty())
+	{
+		const uint8_t *data = getData();
+		const uint8_t *end = data + size();
+		const uint8_t *pos = data;
+		uint32_t val = 0;
+
+		while (pos < end)
+		{
+			IdsBlockSkip skip;
+			skip.offset = pos - data;
+			pos = skipIdsBlock(pos, end, val, skip);
+			m_skips.push_back(skip);
+			val = skip.lastId;
+		}
+	}
+
+	return m_skips;
 }
 
 uint32_t CompressedIds::getLastDelta() const
@@ -220,34 +502,76 @@ uint32_t CompressedIds::getLastDelta() const
 
 CompressedIds::iterator CompressedIds::begin() const
 {
-	return CompressedIds::iterator(m_ids.data(), m_ids.size());
+	return CompressedIds::iterator(getData(), size(), m_format);
 }
 
 CompressedIds::iterator CompressedIds::end() const
 {
-	return CompressedIds::iterator(m_ids.data() + m_ids.size());
+	return CompressedIds::iterator(getData() + size());
 }
 
 
 CompressedIds::iterator::iterator()
-	: m_pos(NULL), m_end(NULL), m_val(0), m_delta(0), m_deltaRep(0)
+	: m_pos(NULL), m_end(NULL), m_val(0), m_delta(0), m_deltaRep(0),
+	m_blocks(false), m_next(NULL), m_blockPos(0), m_blockNo(0)
 {}
 
-CompressedIds::iterator::iterator(const uint8_t *data, size_t size) :
+CompressedIds::iterator::iterator(const uint8_t *data, size_t size,
+		Format format) :
 	m_pos(data - 1),
 	m_end(data + size),
 	m_val(0),
 	m_delta(0),
-	m_deltaRep(0)
+	m_deltaRep(0),
+	m_blocks(format == BLOCKS),
+	m_next(data),
+	m_blockPos(0),
+	m_blockNo(0)
 {
 	operator++();
 }
 
 CompressedIds::iterator::iterator(const uint8_t *data) :
 	m_pos(data),
-	m_end(data)
+	m_end(data),
+	m_val(0),
+	m_delta(0),
+	m_deltaRep(0),
+	m_blocks(false),
+	m_next(data),
+	m_blockPos(0),
+	m_blockNo(0)
 {}
 
+CompressedIds::iterator::iterator(const iterator &it)
+{
+	operator=(it);
+}
+
+CompressedIds::iterator &CompressedIds::iterator::operator= (
+		const iterator &it)
+{
+	m_pos = it.m_pos;
+	m_end = it.m_end;
+	m_val = it.m_val;
+	m_delta = it.m_delta;
+	m_deltaRep = it.m_deltaRep;
+	m_blocks = it.m_blocks;
+	m_next = it.m_next;
+	m_blockPos = it.m_blockPos;
+	m_blockNo = it.m_blockNo;
+
+	if (it.m_block && this != &it)
+	{
+		if (!m_block)
+			m_block.reset(new uint32_t[IDS_BLOCK_SIZE]);
+
+		copy(it.m_block.get(), it.m_block.get() + m_blockNo, m_block.get());
+	}
+
+	return *this;
+}
+
 CompressedIds::iterator &CompressedIds::iterator::operator++()
 {
 	if (m_deltaRep > 0)
@@ -257,6 +581,9 @@ CompressedIds::iterator &CompressedIds::iterator::operator++()
 		return *this;
 	}
 
+	if (m_blocks)
+		return nextBlockId();
+
 	m_pos++;
 	if (m_pos >= m_end)
 	{
@@ -301,3 +628,28 @@ CompressedIds::iterator &CompressedIds::iterator::operator++()
 
 	return *this;
 }
+
+// position points before the end until the last block is consumed
+CompressedIds::iterator &CompressedIds::iterator::nextBlockId()
+{
+	if (++m_blockPos < m_blockNo)
+	{
+		m_val = m_block[m_blockPos];
+	}
+	else if (m_next >= m_end)
+	{
+		m_pos = m_end;
+	}
+	else
+	{
+		if (!m_block)
+			m_block.reset(new uint32_t[IDS_BLOCK_SIZE]);
+
+		m_next = decodeIdsBlock(m_next, m_end, m_block.get(), m_blockNo,
+				m_val);
+		m_blockPos = 0;
+		m_val = m_block[0];
+	}
+
+	return *this;
+}
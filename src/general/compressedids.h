@@ -2,15 +2,26 @@
 #define __COMPRESSED_IDS_H__
 
 #include "ids.h"
+#include "blockcodec.h"
+#include <memory>
 #include <cassert>
 
 
 class CompressedIds
 {
+	public:
+		enum Format
+		{
+			VARINT,		// deltas with repetitions, built by add()
+			BLOCKS,		// see blockcodec.h, read only
+		};
+
 	public:
 		CompressedIds();
 
-		/** Add single ID, must be greater or equal than lastId() */
+		/** Add single ID, must be greater or equal than lastId().
+		 * First ID is never followed by a repetition, so the list head could
+		 * be re-encoded relatively to different base (see encodeDelta) */
 		unsigned add(uint32_t id);
 
 		void clear();
@@ -26,26 +37,60 @@ class CompressedIds
 		bool hasId(uint32_t id) const;
 
 		void decompress(Ids &ids) const;
+
+		/** Leave in ids only IDs present in this list. Blocks of BLOCKS list
+		 * are found through skip table, so only ones that could hold any of
+		 * ids are decoded */
 		void commonPart(Ids &ids) const;
 
+		/** Remove from ids IDs present in this list */
+		void excludeFrom(Ids &ids) const;
+
 		uint32_t firstId() const;
 		uint32_t lastId() const;
 
+		Format getFormat() const;
+
 		const uint8_t *getData() const;
-		uint8_t *setData(size_t size, uint32_t lastId = (uint32_t) -1);
+		uint8_t *setData(size_t size, uint32_t lastId = (uint32_t) -1,
+				Format format = VARINT);
 		uint8_t *appendData(size_t size, uint32_t lastId = (uint32_t) -1);
 		void validate() const;
 
-		void clearChunk();
+		/** Refer to external data instead of copying it, data must outlive
+		 * this object. Any modification makes a private copy first */
+		void setView(const uint8_t *data, size_t size, uint32_t lastId,
+				Format format = VARINT);
+		bool isView() const;
+
+		/** Maximal size of single encoded delta */
+		static const size_t MAX_DELTA_SIZE = 5;
+
+		static size_t encodeDelta(uint32_t delta, uint8_t *data);
+
+		/** Repeat the last delta of list ending with last byte. Repetition
+		 * counter there is increased, or new one is stored to data. Returns
+		 * number of bytes stored (0 or 1) */
+		static size_t encodeRepeat(uint8_t &last, uint8_t *data);
+		static size_t decodeDelta(const uint8_t *data, size_t size,
+				uint32_t &delta);
+
+		/** Re-encode varint list in block format, list head is kept */
+		static void toBlocks(const uint8_t *data, size_t size,
+				std::vector<uint8_t> &out);
 
 	public:
 		class iterator
 		{
 			public:
 				iterator();
-				iterator(const uint8_t *data, size_t size);
+				iterator(const uint8_t *data, size_t size,
+						Format format = VARINT);
 				iterator(const uint8_t *data);
 
+				iterator(const iterator &it);
+				iterator &operator= (const iterator &it);
+
 				uint32_t operator* () const
 				{
 					assert(m_pos < m_end);
@@ -64,6 +109,9 @@ class CompressedIds
 					return m_pos != it.m_pos;
 				}
 
+			private:
+				iterator &nextBlockId();
+
 			private:
 				const uint8_t *m_pos;
 				const uint8_t *m_end;
@@ -71,6 +119,13 @@ class CompressedIds
 				uint32_t m_val;
 				uint32_t m_delta;
 				unsigned m_deltaRep;
+
+				// decoded block of BLOCKS list, allocated on first use
+				bool m_blocks;
+				const uint8_t *m_next;
+				size_t m_blockPos;
+				size_t m_blockNo;
+				std::unique_ptr<uint32_t[]> m_block;
 		};
 
 		iterator begin() const;
@@ -78,12 +133,20 @@ class CompressedIds
 
 	private:
 		uint32_t getLastDelta() const;
+		void detachView();
+
+		/** Skip table of BLOCKS list, built on first use */
+		const std::vector<IdsBlockSkip> &getSkips() const;
 
 	private:
 		std::vector<uint8_t> m_ids;
+		const uint8_t *m_view;
+		size_t m_viewSize;
 		uint32_t m_lastId;
+		Format m_format;
 
 		uint32_t m_lastDelta;
+		mutable std::vector<IdsBlockSkip> m_skips;
 };
 
 #endif
@@ -7,15 +7,29 @@
 #define TRIGRAMS_LIST_FNAME "index"
 #define TRIGRAMS_DATA_FNAME "data"
 #define FILE_LIST_FNAME     "files"
+#define FILES_META_FNAME    "meta"
+#define SEGMENTS_FNAME      "segments"
+#define CHUNKS_LIST_FNAME   "chunks.index"
+#define CHUNKS_DATA_FNAME   "chunks.data"
+#define CHUNKS_FILES_FNAME  "chunks.files"
+#define CHUNKS_META_FNAME   "chunks.meta"
 #define TMP_SUFFIX          ".tmp"
 
 #define TRIGRAMS_LIST_PATH  GRIP_DIR PATH_DELIMITER_S TRIGRAMS_LIST_FNAME
 #define TRIGRAMS_DATA_PATH  GRIP_DIR PATH_DELIMITER_S TRIGRAMS_DATA_FNAME
 #define FILE_LIST_PATH      GRIP_DIR PATH_DELIMITER_S FILE_LIST_FNAME
+#define FILES_META_PATH     GRIP_DIR PATH_DELIMITER_S FILES_META_FNAME
+#define SEGMENTS_PATH       GRIP_DIR PATH_DELIMITER_S SEGMENTS_FNAME
+#define CHUNKS_LIST_PATH    GRIP_DIR PATH_DELIMITER_S CHUNKS_LIST_FNAME
+#define CHUNKS_DATA_PATH    GRIP_DIR PATH_DELIMITER_S CHUNKS_DATA_FNAME
+#define CHUNKS_FILES_PATH   GRIP_DIR PATH_DELIMITER_S CHUNKS_FILES_FNAME
+#define CHUNKS_META_PATH    GRIP_DIR PATH_DELIMITER_S CHUNKS_META_FNAME
 
 #define TRIGRAMS_LIST_PATH_TMP  TRIGRAMS_LIST_PATH TMP_SUFFIX
 #define TRIGRAMS_DATA_PATH_TMP  TRIGRAMS_DATA_PATH TMP_SUFFIX
 #define FILE_LIST_PATH_TMP      FILE_LIST_PATH TMP_SUFFIX
+#define FILES_META_PATH_TMP     FILES_META_PATH TMP_SUFFIX
+#define SEGMENTS_PATH_TMP       SEGMENTS_PATH TMP_SUFFIX
 
 #ifndef VERSION
 #define VERSION "CUSTOM-BUILD"
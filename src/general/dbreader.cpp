@@ -4,6 +4,9 @@
 #include "dir.h"
 #include "case.h"
 #include "config.h"
+#include "segments.h"
+#include "error.h"
+#include <algorithm>
 #include <set>
 #include <cstdio>
 #include <cstring>
@@ -25,12 +28,36 @@ inline uint32_t trigramToLower(uint32_t trigram)
 }
 
 
-DbReader::DbReader(const string &dirDb)
+DbReader::DbReader(const string &dirDb) : m_format(CompressedIds::VARINT)
 {
 	string dir = !dirDb.empty() ? dirDb : getIndexPath();
 
-	m_dataFile.open(dir + PATH_DELIMITER + TRIGRAMS_DATA_PATH, "rb");
-	File(dir + PATH_DELIMITER + TRIGRAMS_LIST_PATH, "rb").readVector(m_indexes);
+	Segments segments;
+	segments.read(dir);
+
+	for (uint32_t segmentNo : segments)
+	{
+		Segment *segment = new Segment();
+		m_segments.emplace_back(segment);
+
+		string dataPath = Segments::dataPath(dir, segmentNo);
+		if (!segment->mappedData.open(dataPath, MappedFile::RANDOM))
+			segment->dataFile.open(dataPath, "rb");
+
+		segment->indexes.read(Segments::indexPath(dir, segmentNo));
+
+		// lists of all segments are concatenated, so they must be the same
+		CompressedIds::Format format =
+			segment->indexes.flags() & INDEX_BLOCK_LISTS ?
+			CompressedIds::BLOCKS : CompressedIds::VARINT;
+
+		if (m_segments.size() == 1)
+			m_format = format;
+		else if (format != m_format)
+			throw ThisError("malformed database, segments lists format differ")
+				.add("segment", segmentNo);
+	}
+
 	m_fileList.read(dir + PATH_DELIMITER + FILE_LIST_PATH);
 }
 
@@ -41,58 +68,221 @@ const CompressedIds &DbReader::get(uint32_t trigram)
 		return it->second;
 
 	CompressedIds &ids = m_chunks[trigram];
-	if (m_indexes.empty())
-		return ids;
-
-	size_t low = 0;
-	size_t high = m_indexes.size() - 1;
-	const Index *data = m_indexes.data();
 
-	while (low <= high)
+	for (auto &segment : m_segments)
 	{
-		size_t mid = (low + high) / 2;
-		uint32_t val = data[mid].trigram;
+		Index index;
+		if (segment->indexes.find(trigram, index))
+			readChunks(*segment, index, ids);
+	}
 
-		if (trigram < val)
-		{
-			if (mid == 0)
-				break;
+	return ids;
+}
 
-			high = mid - 1;
-		}
-		else if (trigram > val)
-		{
-			low = mid + 1;
-		}
+size_t DbReader::getSize(uint32_t trigram) const
+{
+	size_t size = 0;
+
+	for (auto &segment : m_segments)
+	{
+		Index index;
+		if (!segment->indexes.find(trigram, index))
+			continue;
+
+		if (index.complement)
+			size += segment->indexes.endId() - segment->indexes.firstId();
 		else
+			size += index.size;
+	}
+
+	return size;
+}
+
+bool DbReader::isStopGram(uint32_t trigram) const
+{
+	for (auto &segment : m_segments)
+	{
+		Index index;
+		if (!segment->indexes.find(trigram, index) || !index.complement)
+			return false;
+	}
+
+	return !m_segments.empty();
+}
+
+const CompressedIds &DbReader::getComplement(uint32_t trigram)
+{
+	Chunks::const_iterator it = m_complements.find(trigram);
+	if (it != m_complements.end())
+		return it->second;
+
+	CompressedIds &ids = m_complements[trigram];
+
+	for (auto &segment : m_segments)
+	{
+		Index index;
+		if (segment->indexes.find(trigram, index) && index.complement &&
+				index.size > 0)
 		{
-			readChunks(data[mid], ids);
-			return ids;
+			index.complement = false;
+			readChunks(*segment, index, ids);
 		}
 	}
 
 	return ids;
 }
 
-const vector<Index> &DbReader::getIndexes() const
+vector<uint32_t> DbReader::getTrigrams() const
 {
-	return m_indexes;
+	vector<uint32_t> trigrams;
+
+	for (auto &segment : m_segments)
+	{
+		IndexTable::iterator it = segment->indexes.begin();
+		for (; !it.end(); ++it)
+			trigrams.push_back(it->trigram);
+	}
+
+	if (m_segments.size() > 1)
+	{
+		sort(trigrams.begin(), trigrams.end());
+		trigrams.erase(unique(trigrams.begin(), trigrams.end()),
+				trigrams.end());
+	}
+
+	return trigrams;
+}
+
+bool DbReader::isCaseFolded() const
+{
+	for (auto &segment : m_segments)
+	{
+		if (!(segment->indexes.flags() & INDEX_CASE_FOLDED))
+			return false;
+	}
+
+	return !m_segments.empty();
 }
 
 void DbReader::clearCache()
 {
 	m_chunks.clear();
+	m_complements.clear();
+}
+
+void DbReader::readChunks(Segment &segment, const Index &index,
+		CompressedIds &ids)
+{
+	if (index.complement)
+	{
+		readComplement(segment, index, ids);
+		return;
+	}
+
+	const uint8_t *data = NULL;
+	bool append = !ids.empty();
+
+	if (segment.mappedData.isOpen())
+	{
+		if (index.offset + index.size > segment.mappedData.size())
+			throw ThisError("malformed database, list out of data file")
+				.add("file", segment.mappedData.getFileName());
+
+		data = segment.mappedData.data() + index.offset;
+
+		if (!append)
+			ids.setView(data, index.size, index.lastId, m_format);
+	}
+	else
+	{
+		segment.dataFile.seek(index.offset);
+
+		if (!append)
+		{
+			segment.dataFile.read(ids.setData(index.size, index.lastId,
+						m_format), index.size);
+		}
+		else
+		{
+			m_buffer.resize(index.size);
+			segment.dataFile.read(m_buffer.data(), index.size);
+			data = m_buffer.data();
+		}
+	}
+
+	if (append)
+		appendChunk(data, index.size, index.lastId, ids);
+
+	ids.validate();
 }
 
-void DbReader::readChunks(const Index &index, CompressedIds &ids)
+/* Files of segment range that are not on complement list */
+void DbReader::readComplement(Segment &segment, const Index &index,
+		CompressedIds &ids)
 {
-	m_dataFile.seek(index.offset);
-	uint8_t *data = ids.setData(index.size, index.lastId);
-	m_dataFile.read(data, index.size);
+	CompressedIds complement;
+	if (index.size > 0)
+	{
+		Index plain = index;
+		plain.complement = false;
+		readChunks(segment, plain, complement);
+	}
+
+	CompressedIds list;
+	CompressedIds::iterator it = complement.begin();
+
+	for (uint32_t id = segment.indexes.firstId();
+			id < segment.indexes.endId(); id++)
+	{
+		while (!it.end() && *it < id)
+			++it;
+
+		if (it.end() || *it != id)
+			list.add(id);
+	}
+
+	if (list.empty())
+		return;
+
+	const uint8_t *data = list.getData();
+	size_t size = list.size();
+
+	if (m_format == CompressedIds::BLOCKS)
+	{
+		CompressedIds::toBlocks(data, size, m_buffer);
+		data = m_buffer.data();
+		size = m_buffer.size();
+	}
+
+	if (ids.empty())
+		memcpy(ids.setData(size, list.lastId(), m_format), data, size);
+	else
+		appendChunk(data, size, list.lastId(), ids);
 
 	ids.validate();
 }
 
+void DbReader::appendChunk(const uint8_t *data, size_t size, uint32_t lastId,
+		CompressedIds &ids)
+{
+	// every segment list starts with absolute ID, make it relative to the
+	// last ID of preceding segment
+	uint32_t firstId;
+	size_t oldHeadSize = CompressedIds::decodeDelta(data, size, firstId);
+
+	if (firstId <= ids.lastId())
+		throw ThisError("malformed database, overlapping segments");
+
+	uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+	size_t headSize = CompressedIds::encodeDelta(firstId - ids.lastId(),
+			head);
+
+	size -= oldHeadSize;
+	uint8_t *dst = ids.appendData(headSize + size, lastId);
+	memcpy(dst, head, headSize);
+	memcpy(dst + headSize, data + oldHeadSize, size);
+}
+
 const string &DbReader::getFile(uint32_t id) const
 {
 	return m_fileList.get(id);
@@ -102,3 +292,8 @@ uint32_t DbReader::getFilesNo() const
 {
 	return m_fileList.size();
 }
+
+size_t DbReader::getSegmentsNo() const
+{
+	return m_segments.size();
+}
@@ -2,38 +2,79 @@
 #define __DB_READER_H__
 
 #include "index.h"
+#include "indextable.h"
 #include "compressedids.h"
-#include "filelist.h"
+#include "filetable.h"
+#include "mappedfile.h"
 #include "file.h"
 #include <vector>
 #include <map>
+#include <memory>
 #include <string>
 #include <stdint.h>
 
 
+/* Reads database consisting of one or more segments, trigram lists of all
+ * segments are concatenated. Removed files are not filtered out, their names
+ * are empty.
+ * Index and data files are memory mapped when possible, then lists of single
+ * segment database are returned without copying. Complement lists of
+ * stop-grams (see IndexTable) are turned back to the regular ones by get. */
 class DbReader
 {
 	public:
 		DbReader(const std::string &dir = "");
 
 		const CompressedIds &get(uint32_t trigram);
-		const std::vector<Index> &getIndexes() const;
+
+		/** Size of trigram list in bytes, the list is not read. Complement
+		 * list counts as one byte per file of its segment. */
+		size_t getSize(uint32_t trigram) const;
+
+		/** Trigram is stored as complement list in every segment */
+		bool isStopGram(uint32_t trigram) const;
+
+		/** Files without stop-gram, concatenated complement lists */
+		const CompressedIds &getComplement(uint32_t trigram);
+
+		/** Sorted trigrams present in any segment */
+		std::vector<uint32_t> getTrigrams() const;
+
+		/** Every segment stores case-folded trigrams (see foldTrigram) */
+		bool isCaseFolded() const;
 
 		void clearCache();
 
+		/** Name is valid until the next call */
 		const std::string &getFile(uint32_t id) const;
 		uint32_t getFilesNo() const;
 
+		size_t getSegmentsNo() const;
+
 	private:
-		void readChunks(const Index &index, CompressedIds &ids);
+		struct Segment
+		{
+			IndexTable indexes;
+			MappedFile mappedData;
+			File dataFile;
+		};
+
+		void readChunks(Segment &segment, const Index &index,
+				CompressedIds &ids);
+		void readComplement(Segment &segment, const Index &index,
+				CompressedIds &ids);
+		void appendChunk(const uint8_t *data, size_t size, uint32_t lastId,
+				CompressedIds &ids);
 
 	private:
-		std::vector<Index> m_indexes;
-		File m_dataFile;
-		Files m_fileList;
+		std::vector<std::unique_ptr<Segment>> m_segments;
+		CompressedIds::Format m_format;
+		FileTable m_fileList;
+		std::vector<uint8_t> m_buffer;
 
 		typedef std::map<uint32_t /* trigram */, CompressedIds> Chunks;
 		Chunks m_chunks;
+		Chunks m_complements;
 };
 
 #endif
@@ -162,6 +162,18 @@ bool directoryExists(const char *path)
 	}
 }
 
+bool getFileInfo(const string &path, uint64_t &size, int64_t &mtime)
+{
+	system::error_code ec;
+
+	size = filesystem::file_size(path, ec);
+	if (ec)
+		return false;
+
+	mtime = filesystem::last_write_time(path, ec);
+	return !ec;
+}
+
 bool isAbsolutePath(const string &path)
 {
 	return filesystem::path(path).has_root_directory();
@@ -2,6 +2,7 @@
 #define __DIR_H__
 
 #include <string>
+#include <stdint.h>
 
 
 #ifndef PATH_DELIMITER
@@ -21,6 +22,9 @@ void makeDirectory(const std::string &path);
 std::string getCurrentDirectory();
 bool directoryExists(const char *path);
 
+/** Returns false if file does not exist */
+bool getFileInfo(const std::string &path, uint64_t &size, int64_t &mtime);
+
 bool isAbsolutePath(const std::string &path);
 
 // dir and path must be canonical
@@ -1,6 +1,5 @@
 #include "filelist.h"
-#include "file.h"
-#include "fileline.h"
+#include "filetable.h"
 
 using namespace std;
 
@@ -38,22 +37,23 @@ bool Files::empty() const
 
 void Files::write(const string &fname) const
 {
-	File file(fname, "wb");
+	FileTableWriter file(fname);
 
 	for (auto &name : m_files)
-		file.writeLine(name);
+		file.add(name);
+
+	file.finish();
 }
 
 void Files::read(const string &fname)
 {
 	clear();
-	FileLineReader file(fname);
+	FileTable file;
+	file.read(fname);
 
-	const char *line;
-	while ((line = file.readLine(false)) != NULL)
-	{
-		m_files.push_back(line);
-	}
+	m_files.reserve(file.size());
+	for (uint32_t id = 0; id < file.size(); id++)
+		m_files.push_back(file.get(id));
 }
 
 Files::iterator Files::begin()
@@ -0,0 +1,240 @@
+#include "filetable.h"
+#include "error.h"
+#include <cstring>
+
+using namespace std;
+
+
+FileTable::FileTable() : m_data(NULL), m_blocks(NULL), m_dataSize(0),
+	m_size(0), m_next(NULL), m_nextId(0)
+{}
+
+void FileTable::read(const string &fname)
+{
+	m_buffer.clear();
+	m_file.close();
+	m_fname = fname;
+
+	if (m_file.open(fname, MappedFile::RANDOM))
+	{
+		setData(m_file.data(), m_file.size());
+	}
+	else
+	{
+		File(fname, "rb").readVector(m_buffer);
+		setData(m_buffer.data(), m_buffer.size());
+	}
+}
+
+void FileTable::setData(const uint8_t *data, size_t size)
+{
+	const FileTableHeader *header = (const FileTableHeader*) data;
+
+	if (size < sizeof(FileTableHeader) || header->magic != FILE_TABLE_MAGIC)
+		throw ThisError("unsupported database format, rebuild the index")
+			.add("file", m_fname);
+
+	size_t blocksNo = (header->filesNo + FILE_TABLE_BLOCK - 1)
+		/ FILE_TABLE_BLOCK;
+
+	if (header->blocksOffset < sizeof(FileTableHeader) ||
+			header->blocksOffset % sizeof(uint64_t) ||
+			size - header->blocksOffset != blocksNo * sizeof(uint64_t))
+	{
+		malformed();
+	}
+
+	m_data = data;
+	m_blocks = (const uint64_t*) (data + header->blocksOffset);
+	m_dataSize = header->blocksOffset;
+	m_size = header->filesNo;
+
+	m_name.clear();
+	m_next = NULL;
+	m_nextId = 0;
+}
+
+const string &FileTable::get(uint32_t id) const
+{
+	if (id >= m_size)
+		throw ThisError("malformed database, invalid file ID")
+			.add("id", id)
+			.add("file", m_fname);
+
+	if (id + 1 == m_nextId)
+		return m_name;
+
+	// continue from the last name if it is in the same block
+	const uint8_t *pos = m_next;
+	uint32_t no = m_nextId;
+
+	if (id < m_nextId || m_next == NULL ||
+			id / FILE_TABLE_BLOCK != m_nextId / FILE_TABLE_BLOCK)
+	{
+		size_t block = id / FILE_TABLE_BLOCK;
+		if (m_blocks[block] < sizeof(FileTableHeader) ||
+				m_blocks[block] > m_dataSize)
+		{
+			malformed();
+		}
+
+		pos = m_data + m_blocks[block];
+		no = block * FILE_TABLE_BLOCK;
+	}
+
+	// name could be left half decoded on error
+	m_next = NULL;
+	m_nextId = 0;
+
+	for (; no <= id; no++)
+	{
+		size_t prefix = decodeLength(pos);
+		size_t len = decodeLength(pos);
+
+		if (no % FILE_TABLE_BLOCK == 0)
+			prefix = 0;
+
+		if (prefix > m_name.size() ||
+				len > (size_t) (m_data + m_dataSize - pos))
+		{
+			malformed();
+		}
+
+		m_name.resize(prefix);
+		m_name.append((const char*) pos, len);
+		pos += len;
+	}
+
+	m_next = pos;
+	m_nextId = id + 1;
+	return m_name;
+}
+
+size_t FileTable::decodeLength(const uint8_t *&pos) const
+{
+	const uint8_t *end = m_data + m_dataSize;
+	size_t len = 0;
+
+	for (unsigned shift = 0; pos < end && shift < 32; shift += 7)
+	{
+		uint8_t byte = *pos++;
+		len |= (size_t) (byte & 0x7f) << shift;
+
+		if ((byte & 0x80) == 0)
+			return len;
+	}
+
+	malformed();
+	return 0;
+}
+
+void FileTable::malformed() const
+{
+	throw ThisError("malformed database, invalid file list")
+		.add("file", m_fname);
+}
+
+uint32_t FileTable::size() const
+{
+	return m_size;
+}
+
+bool FileTable::empty() const
+{
+	return m_size == 0;
+}
+
+
+FileTableWriter::FileTableWriter() : m_offset(0), m_filesNo(0)
+{}
+
+FileTableWriter::FileTableWriter(const string &fname)
+	: m_offset(0), m_filesNo(0)
+{
+	open(fname);
+}
+
+void FileTableWriter::open(const string &fname)
+{
+	m_file.open(fname, "wb");
+	m_prev.clear();
+	m_blocks.clear();
+	m_filesNo = 0;
+
+	// header is filled when the table is complete
+	FileTableHeader header = {0, 0, 0};
+	m_file.writeObj(header);
+	m_offset = sizeof(header);
+}
+
+void FileTableWriter::add(const char *name, size_t len)
+{
+	size_t prefix = 0;
+
+	if (m_filesNo % FILE_TABLE_BLOCK == 0)
+	{
+		m_blocks.push_back(m_offset);
+	}
+	else
+	{
+		size_t maxPrefix = min(len, m_prev.size());
+		while (prefix < maxPrefix && name[prefix] == m_prev[prefix])
+			prefix++;
+	}
+
+	m_buffer.clear();
+	encodeLength(prefix);
+	encodeLength(len - prefix);
+	m_buffer.insert(m_buffer.end(), name + prefix, name + len);
+
+	m_file.writeVector(m_buffer);
+	m_offset += m_buffer.size();
+	m_prev.assign(name, len);
+	m_filesNo++;
+}
+
+void FileTableWriter::add(const string &name)
+{
+	add(name.c_str(), name.size());
+}
+
+void FileTableWriter::encodeLength(size_t len)
+{
+	while (len >= 0x80)
+	{
+		m_buffer.push_back((len & 0x7f) | 0x80);
+		len >>= 7;
+	}
+
+	m_buffer.push_back(len);
+}
+
+void FileTableWriter::finish()
+{
+	// offsets of blocks are aligned
+	static const uint8_t padding[sizeof(uint64_t)] = {0};
+	size_t paddingSize = (sizeof(uint64_t) - m_offset % sizeof(uint64_t))
+		% sizeof(uint64_t);
+
+	m_file.write(padding, paddingSize);
+	m_file.writeVector(m_blocks);
+
+	FileTableHeader header;
+	header.magic = FILE_TABLE_MAGIC;
+	header.filesNo = m_filesNo;
+	header.blocksOffset = m_offset + paddingSize;
+
+	m_file.seek(0);
+	m_file.writeObj(header);
+	m_file.flush();
+}
+
+void FileTableWriter::close()
+{
+	m_file.close();
+}
+
+void FileTableWriter::renameAndClose(const string &newName)
+{
+	m_file.renameAndClose(newName);
+}
@@ -0,0 +1,97 @@
+#ifndef __FILE_TABLE_H__
+#define __FILE_TABLE_H__
+
+#include "mappedfile.h"
+#include "file.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+
+/* File names table: header, names in blocks of FILE_TABLE_BLOCK and offsets
+ * of blocks. Every name is stored as length of prefix shared with the
+ * previous one, length of the rest and the rest itself, lengths are varints.
+ * The first name of block is stored whole, so any name is decoded from its
+ * block start. */
+#define FILE_TABLE_MAGIC	0x31544c46	// "FLT1"
+#define FILE_TABLE_BLOCK	16
+
+struct FileTableHeader
+{
+	uint32_t magic;
+	uint32_t filesNo;
+	uint64_t blocksOffset;
+};
+
+
+/* Read-only file names table. File is memory mapped when possible, names
+ * are decoded on request. Consecutive names are decoded incrementally, so
+ * reading in IDs order is cheap. Not thread safe. */
+class FileTable
+{
+	public:
+		FileTable();
+
+		void read(const std::string &fname);
+
+		/** Name is valid until the next call, removed files have empty
+		 * names */
+		const std::string &get(uint32_t id) const;
+
+		uint32_t size() const;
+		bool empty() const;
+
+	private:
+		FileTable(const FileTable &);
+		FileTable &operator= (const FileTable &);
+
+		void setData(const uint8_t *data, size_t size);
+		size_t decodeLength(const uint8_t *&pos) const;
+		void malformed() const;
+
+	private:
+		MappedFile m_file;
+		std::vector<uint8_t> m_buffer;
+		std::string m_fname;
+
+		const uint8_t *m_data;
+		const uint64_t *m_blocks;
+		size_t m_dataSize;
+		uint32_t m_size;
+
+		// position following the last decoded name
+		mutable std::string m_name;
+		mutable const uint8_t *m_next;
+		mutable uint32_t m_nextId;
+};
+
+/* Writes file names table, names are added in IDs order */
+class FileTableWriter
+{
+	public:
+		FileTableWriter();
+		FileTableWriter(const std::string &fname);
+
+		void open(const std::string &fname);
+		void add(const char *name, size_t len);
+		void add(const std::string &name);
+
+		/** Write offsets of blocks and header */
+		void finish();
+
+		void close();
+		void renameAndClose(const std::string &newName);
+
+	private:
+		void encodeLength(size_t len);
+
+	private:
+		File m_file;
+		std::string m_prev;
+		std::vector<uint64_t> m_blocks;
+		std::vector<uint8_t> m_buffer;
+		uint64_t m_offset;
+		uint32_t m_filesNo;
+};
+
+#endif
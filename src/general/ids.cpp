@@ -3,9 +3,94 @@
 #include <cstring>
 #include <algorithm>
 
+#if defined(__GNUC__) && defined(__SSE2__) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define INTERSECT_SSE2
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 
+/* Intersection of sorted lists, returns number of IDs stored to out. Output
+ * never overtakes a, so out may be the same as a, otherwise it must have room
+ * for 3 IDs more than the result. */
+static size_t intersect(const uint32_t *a, size_t aNo, const uint32_t *b,
+		size_t bNo, uint32_t *out)
+{
+	size_t i = 0, j = 0, no = 0;
+
+#ifdef INTERSECT_SSE2
+	// four IDs of a are compared with every rotation of four IDs of b,
+	// matches are stored when a advances, so its block is not overwritten
+	// while it is still compared
+	unsigned mask = 0;
+
+	while (i + 4 <= aNo && j + 4 <= bNo)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*) (b + j));
+
+		__m128i eq = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi32(va, vb),
+					_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39))),
+				_mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e)),
+					_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93))));
+		mask |= _mm_movemask_ps(_mm_castsi128_ps(eq));
+
+		uint32_t aMax = a[i + 3];
+		uint32_t bMax = b[j + 3];
+
+		if (aMax <= bMax)
+		{
+			// written unconditionally, only matching IDs are kept
+			uint32_t found[4];
+			_mm_storeu_si128((__m128i*) found, va);
+			for (unsigned k = 0; k < 4; k++)
+			{
+				out[no] = found[k];
+				no += (mask >> k) & 1;
+			}
+
+			mask = 0;
+			i += 4;
+		}
+
+		if (bMax <= aMax)
+			j += 4;
+	}
+
+	// matches of unfinished block are lower than b[j], so they are skipped
+	// below
+	for (unsigned k = 0; mask >> k; k++)
+	{
+		if ((mask >> k) & 1)
+			out[no++] = a[i + k];
+	}
+#endif
+
+	while (i < aNo && j < bNo)
+	{
+		if (a[i] < b[j])
+		{
+			i++;
+		}
+		else if (b[j] < a[i])
+		{
+			j++;
+		}
+		else
+		{
+			out[no++] = a[i];
+			i++;
+			j++;
+		}
+	}
+
+	return no;
+}
+
+
 bool Ids::add(uint32_t id)
 {
 	if (m_ids.empty())
@@ -79,17 +164,27 @@ bool Ids::hasId(uint32_t id) const
 
 void Ids::commonPart(const Ids &ids1, const Ids &ids2)
 {
-	m_ids.resize(max(ids1.size(), ids2.size()));
-	auto begin = m_ids.begin();
-	auto end = set_intersection(ids1.begin(), ids1.end(), ids2.begin(), ids2.end(), begin);
-	m_ids.resize(end - begin);
+	if (this == &ids1)
+	{
+		commonPart(ids2);
+	}
+	else if (this == &ids2)
+	{
+		commonPart(ids1);
+	}
+	else
+	{
+		// vectorized intersection could write 3 IDs past the result
+		m_ids.resize(min(ids1.size(), ids2.size()) + 3);
+		m_ids.resize(intersect(ids1.getData(), ids1.size(),
+					ids2.getData(), ids2.size(), m_ids.data()));
+	}
 }
 
 void Ids::commonPart(const Ids &ids)
 {
-	Ids result;
-	result.commonPart(*this, ids);
-	swap(result);
+	m_ids.resize(intersect(m_ids.data(), m_ids.size(),
+				ids.getData(), ids.size(), m_ids.data()));
 }
 
 bool Ids::operator== (const Ids &ids) const
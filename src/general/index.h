@@ -3,23 +3,44 @@
 
 #include <cstddef>
 #include <stdint.h>
+#include "case.h"
 
 
+/* Case-folded trigrams are stored next to the exact ones, with letters
+ * turned to lower case and this bit set. Trigrams without letters are never
+ * folded, their exact lists are used instead. */
+#define TRIGRAM_FOLDED	0x1000000
+
+inline uint32_t foldTrigram(uint32_t trigram)
+{
+	uint32_t a = (trigram >> 16) & 0xff;
+	uint32_t b = (trigram >> 8) & 0xff;
+	uint32_t c = trigram & 0xff;
+
+	if (!IS_ALPHA(a) && !IS_ALPHA(b) && !IS_ALPHA(c))
+		return trigram;
+
+	return TRIGRAM_FOLDED | TO_LOWER(a) << 16 | TO_LOWER(b) << 8 | TO_LOWER(c);
+}
+
 struct Index
 {
 	uint32_t trigram;
 	uint32_t lastId;
 	size_t offset;
 	size_t size;
+	bool complement;	// list of files without trigram, see IndexTable
 
 	inline Index() {}
 
-	inline Index(uint32_t trigram, size_t offset, size_t size, uint32_t lastId)
-		: trigram(trigram), lastId(lastId), offset(offset), size(size) {}
+	inline Index(uint32_t trigram, size_t offset, size_t size, uint32_t lastId,
+			bool complement = false)
+		: trigram(trigram), lastId(lastId), offset(offset), size(size),
+		complement(complement) {}
 
 	inline bool isValid() const
 	{
-		return (trigram & 0xff000000) == 0;
+		return (trigram & 0xfe000000) == 0;
 	}
 
 	inline void invalidate()
@@ -0,0 +1,249 @@
+#include "indextable.h"
+#include "file.h"
+#include "error.h"
+#include <algorithm>
+
+using namespace std;
+
+
+IndexTable::IndexTable() : m_buckets(NULL), m_sparseBuckets(NULL),
+	m_entries(NULL), m_size(0), m_slotsNo(0), m_bucketsNo(0), m_flags(0),
+	m_firstId(0), m_endId(0), m_stopGrams(0)
+{}
+
+void IndexTable::read(const string &fname)
+{
+	m_buffer.clear();
+	m_file.close();
+	m_fname = fname;
+
+	if (m_file.open(fname, MappedFile::RANDOM))
+	{
+		setData(m_file.data(), m_file.size());
+	}
+	else
+	{
+		File(fname, "rb").readVector(m_buffer);
+		setData(m_buffer.data(), m_buffer.size());
+	}
+}
+
+void IndexTable::setData(const uint8_t *data, size_t size)
+{
+	const IndexHeader *header = (const IndexHeader*) data;
+
+	if (size < indexEntryPos(0) || header->magic != INDEX_MAGIC)
+		throw ThisError("unsupported database format, rebuild the index")
+			.add("file", m_fname);
+
+	m_flags = header->flags;
+	m_bucketsNo = indexBucketsNo(m_flags);
+	m_size = header->entriesNo;
+	m_firstId = header->firstId;
+	m_endId = header->endId;
+	m_stopGrams = header->stopGrams;
+
+	if (m_firstId > m_endId)
+	{
+		throw ThisError("malformed database, invalid IDs range")
+			.add("file", m_fname);
+	}
+
+	size_t tablePos = indexBucketPos(m_size, 0);
+	size_t tableSize = size >= tablePos ? size - tablePos : 0;
+	bool valid;
+
+	m_entries = (const IndexEntry*) (data + indexEntryPos(0));
+
+	if (m_flags & INDEX_SPARSE_BUCKETS)
+	{
+		m_buckets = NULL;
+		m_sparseBuckets = (const IndexBucket*) (data + tablePos);
+		m_slotsNo = tableSize / sizeof(IndexBucket) - 1;
+
+		valid = tableSize >= sizeof(IndexBucket) &&
+			tableSize % sizeof(IndexBucket) == 0 &&
+			m_sparseBuckets[m_slotsNo].bucket == m_bucketsNo &&
+			m_sparseBuckets[m_slotsNo].entry == m_size;
+	}
+	else
+	{
+		m_buckets = (const uint32_t*) (data + tablePos);
+		m_sparseBuckets = NULL;
+		m_slotsNo = m_bucketsNo;
+
+		valid = tableSize == (m_bucketsNo + 1) * sizeof(uint32_t) &&
+			m_buckets[m_bucketsNo] == m_size;
+	}
+
+	if (!valid)
+	{
+		throw ThisError("malformed database, invalid index size")
+			.add("file", m_fname);
+	}
+}
+
+bool IndexTable::find(uint32_t trigram, Index &index) const
+{
+	uint32_t bucket = indexBucket(trigram);
+	size_t slot;
+
+	if (m_size == 0 || !findSlot(bucket, slot))
+		return false;
+
+	size_t low = slotEntry(slot);
+	size_t high = slotEntry(slot + 1);
+
+	if (low > high || high > m_size)
+		throw ThisError("malformed database, invalid index bucket")
+			.add("file", m_fname);
+
+	uint8_t byte = trigram & 0xff;
+
+	while (low < high)
+	{
+		size_t mid = (low + high) / 2;
+		uint8_t val = m_entries[mid].trigramByte();
+
+		if (byte < val)
+		{
+			high = mid;
+		}
+		else if (byte > val)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			getIndex(bucket, mid, index);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void IndexTable::getIndex(uint32_t bucket, size_t pos, Index &index) const
+{
+	const IndexEntry &entry = m_entries[pos];
+	uint64_t offset = entry.offset();
+	uint64_t end = m_entries[pos + 1].offset();
+
+	if (end < offset)
+		throw ThisError("malformed database, invalid list offset")
+			.add("file", m_fname);
+
+	index.trigram = bucket << 8 | entry.trigramByte();
+	index.lastId = entry.lastId;
+	index.offset = offset;
+	index.size = end - offset;
+	index.complement = entry.complement();
+}
+
+bool IndexTable::findSlot(uint32_t bucket, size_t &slot) const
+{
+	if (bucket >= m_bucketsNo)
+		return false;
+
+	if (m_sparseBuckets == NULL)
+	{
+		slot = bucket;
+		return true;
+	}
+
+	const IndexBucket *end = m_sparseBuckets + m_slotsNo;
+	const IndexBucket *it = lower_bound(m_sparseBuckets, end,
+			IndexBucket(bucket, 0));
+
+	slot = it - m_sparseBuckets;
+	return it != end && it->bucket == bucket;
+}
+
+uint32_t IndexTable::slotBucket(size_t slot) const
+{
+	return m_sparseBuckets ? m_sparseBuckets[slot].bucket : slot;
+}
+
+size_t IndexTable::slotEntry(size_t slot) const
+{
+	return m_sparseBuckets ? m_sparseBuckets[slot].entry : m_buckets[slot];
+}
+
+IndexTable::iterator IndexTable::begin() const
+{
+	return iterator(this);
+}
+
+size_t IndexTable::size() const
+{
+	return m_size;
+}
+
+bool IndexTable::empty() const
+{
+	return m_size == 0;
+}
+
+uint32_t IndexTable::flags() const
+{
+	return m_flags;
+}
+
+uint32_t IndexTable::firstId() const
+{
+	return m_firstId;
+}
+
+uint32_t IndexTable::endId() const
+{
+	return m_endId;
+}
+
+uint32_t IndexTable::stopGrams() const
+{
+	return m_stopGrams;
+}
+
+
+IndexTable::iterator::iterator(const IndexTable *table)
+	: m_table(table), m_pos(0), m_slot(0)
+{
+	if (!end())
+		readIndex();
+}
+
+const Index &IndexTable::iterator::operator* () const
+{
+	return m_index;
+}
+
+const Index *IndexTable::iterator::operator-> () const
+{
+	return &m_index;
+}
+
+IndexTable::iterator &IndexTable::iterator::operator++ ()
+{
+	m_pos++;
+
+	if (!end())
+		readIndex();
+
+	return *this;
+}
+
+bool IndexTable::iterator::end() const
+{
+	return m_table == NULL || m_pos >= m_table->m_size;
+}
+
+void IndexTable::iterator::readIndex()
+{
+	while (m_slot < m_table->m_slotsNo &&
+			m_table->slotEntry(m_slot + 1) <= m_pos)
+	{
+		m_slot++;
+	}
+
+	m_table->getIndex(m_table->slotBucket(m_slot), m_pos, m_index);
+}
@@ -0,0 +1,200 @@
+#ifndef __INDEX_TABLE_H__
+#define __INDEX_TABLE_H__
+
+#include "index.h"
+#include "mappedfile.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+
+/* Trigram directory file: header, entriesNo + 1 entries and bucket table.
+ * Bucket groups trigrams of the same two most significant bytes, its position
+ * is number of its first entry, so entries of bucket b are between positions
+ * b and b + 1. Entries are sorted by trigram and their lists are stored
+ * contiguously in the data file - list size is the difference of consecutive
+ * offsets, the last entry only marks end of data. Directory with case-folded
+ * trigrams has twice as many buckets. Bucket table holds bucketsNo + 1
+ * positions, or when most buckets are empty (small segments) it is sparse:
+ * bucket and position pairs of non-empty buckets, terminated by bucketsNo.
+ * Header holds range of file IDs covered by the segment. Trigram present in
+ * more than stopGrams percent of its files (stop-gram) could be stored as
+ * complement list - files of the range that do not contain it. Removed files
+ * are never on complement lists.
+ */
+#define INDEX_MAGIC			0x34584449	// "IDX4"
+#define INDEX_BUCKETS_NO	0x10000
+
+/* Index header flags */
+#define INDEX_CASE_FOLDED	0x01
+#define INDEX_BLOCK_LISTS	0x02	// lists in CompressedIds::BLOCKS format
+#define INDEX_SPARSE_BUCKETS	0x04	// set by IndexWriter
+
+inline uint32_t indexBucket(uint32_t trigram)
+{
+	return trigram >> 8;
+}
+
+inline uint32_t indexBucketsNo(uint32_t flags)
+{
+	return flags & INDEX_CASE_FOLDED ? 2 * INDEX_BUCKETS_NO : INDEX_BUCKETS_NO;
+}
+
+/** Sparse bucket table is used when less than this number of buckets is
+ * non-empty, it is then at most quarter of the size of the dense one */
+inline uint32_t indexSparseLimit(uint32_t flags)
+{
+	return indexBucketsNo(flags) / 8;
+}
+
+struct IndexHeader
+{
+	uint32_t magic;
+	uint32_t entriesNo;
+	uint32_t flags;
+	uint32_t firstId;
+	uint32_t endId;
+	uint32_t stopGrams;		// threshold in percents, 0 if disabled
+};
+
+/* 55-bit data offset, the last ID, complement flag and the least
+ * significant byte of trigram, the rest of it is given by bucket */
+struct IndexEntry
+{
+	uint32_t lastId;
+	uint32_t offsetLow;
+	uint32_t key;		// trigram byte, offset bits 32-54 and complement flag
+
+	inline IndexEntry() {}
+
+	inline IndexEntry(uint32_t trigram, uint64_t offset, uint32_t lastId,
+			bool complement = false)
+		: lastId(lastId), offsetLow((uint32_t) offset),
+		key((trigram & 0xff) | (uint32_t) (offset >> 32 << 8) |
+				(complement ? 0x80000000 : 0)) {}
+
+	inline uint8_t trigramByte() const
+	{
+		return key & 0xff;
+	}
+
+	inline uint64_t offset() const
+	{
+		return (uint64_t) (key >> 8 & 0x7fffff) << 32 | offsetLow;
+	}
+
+	inline bool complement() const
+	{
+		return key >> 31;
+	}
+};
+
+/* Record of sparse bucket table */
+struct IndexBucket
+{
+	uint32_t bucket;
+	uint32_t entry;
+
+	inline IndexBucket() {}
+
+	inline IndexBucket(uint32_t bucket, uint32_t entry)
+		: bucket(bucket), entry(entry) {}
+
+	bool operator< (const IndexBucket &bucket) const
+	{
+		return this->bucket < bucket.bucket;
+	}
+};
+
+inline size_t indexEntryPos(size_t entry)
+{
+	return sizeof(IndexHeader) + entry * sizeof(IndexEntry);
+}
+
+inline size_t indexBucketPos(size_t entriesNo, size_t bucket)
+{
+	return indexEntryPos(entriesNo + 1) + bucket * sizeof(uint32_t);
+}
+
+
+/* Read-only trigram directory. File is memory mapped when possible,
+ * otherwise it is read to memory. */
+class IndexTable
+{
+	public:
+		/* Visits indexes in trigrams order */
+		class iterator
+		{
+			public:
+				iterator(const IndexTable *table = NULL);
+
+				const Index &operator* () const;
+				const Index *operator-> () const;
+				iterator &operator++ ();
+				bool end() const;
+
+			private:
+				void readIndex();
+
+			private:
+				const IndexTable *m_table;
+				size_t m_pos;
+				size_t m_slot;
+				Index m_index;
+		};
+
+	public:
+		IndexTable();
+
+		void read(const std::string &fname);
+
+		/** Returns false if trigram is not present */
+		bool find(uint32_t trigram, Index &index) const;
+
+		iterator begin() const;
+		size_t size() const;
+		bool empty() const;
+
+		/** Header flags (INDEX_CASE_FOLDED, INDEX_BLOCK_LISTS,
+		 * INDEX_SPARSE_BUCKETS) */
+		uint32_t flags() const;
+
+		/** Range of file IDs covered by segment, complement lists are
+		 * relative to it */
+		uint32_t firstId() const;
+		uint32_t endId() const;
+
+		/** Stop-grams threshold (in percents) */
+		uint32_t stopGrams() const;
+
+	private:
+		IndexTable(const IndexTable &);
+		IndexTable &operator= (const IndexTable &);
+
+		void setData(const uint8_t *data, size_t size);
+		void getIndex(uint32_t bucket, size_t pos, Index &index) const;
+
+		/** Slot of bucket table, sparse table has slots of non-empty
+		 * buckets only */
+		bool findSlot(uint32_t bucket, size_t &slot) const;
+		uint32_t slotBucket(size_t slot) const;
+		size_t slotEntry(size_t slot) const;
+
+	private:
+		MappedFile m_file;
+		std::vector<uint8_t> m_buffer;
+		std::string m_fname;
+
+		const uint32_t *m_buckets;
+		const IndexBucket *m_sparseBuckets;
+		const IndexEntry *m_entries;
+		size_t m_size;
+		size_t m_slotsNo;
+		uint32_t m_bucketsNo;
+		uint32_t m_flags;
+		uint32_t m_firstId;
+		uint32_t m_endId;
+		uint32_t m_stopGrams;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "indexwriter.h"
+#include "indextable.h"
+#include "error.h"
+
+using namespace std;
+
+
+#define MAX_DATA_SIZE	(1ull << 55)
+
+
+IndexWriter::IndexWriter(const string &fname, uint32_t flags,
+		const char *mode)
+	: m_file(fname, mode), m_flags(flags & ~INDEX_SPARSE_BUCKETS),
+	m_firstId(0), m_endId(0), m_stopGrams(0),
+	m_bucketsNo(indexBucketsNo(flags)), m_firstBucket(0), m_entryNo(0),
+	m_entriesNo(0), m_shared(false)
+{
+	m_file.seek(indexEntryPos(0));
+}
+
+void IndexWriter::setEntriesNo(size_t entriesNo)
+{
+	m_entriesNo = entriesNo;
+	m_shared = true;
+}
+
+void IndexWriter::startRange(uint32_t firstBucket, size_t entryNo)
+{
+	if (m_shared)
+	{
+		m_buckets.clear();
+		m_firstBucket = firstBucket;
+	}
+	else if (entryNo != m_entryNo ||
+			firstBucket < m_firstBucket + m_buckets.size())
+	{
+		throw ThisError("index ranges out of order")
+			.add("bucket", firstBucket);
+	}
+
+	m_entryNo = entryNo;
+	m_file.seek(indexEntryPos(entryNo));
+}
+
+void IndexWriter::write(const Index &index)
+{
+	uint32_t bucket = indexBucket(index.trigram);
+
+	if (!index.isValid() || bucket < m_firstBucket || bucket >= m_bucketsNo ||
+			bucket + 1 < m_firstBucket + m_buckets.size())
+	{
+		throw ThisError("indexes out of order")
+			.add("trigram", index.trigram);
+	}
+
+	if ((uint64_t) index.offset >= MAX_DATA_SIZE)
+		throw ThisError("database too big");
+
+	while (m_firstBucket + m_buckets.size() <= bucket)
+		m_buckets.push_back(m_entryNo);
+
+	m_file.writeObj(IndexEntry(index.trigram, index.offset, index.lastId,
+				index.complement));
+	m_entryNo++;
+}
+
+void IndexWriter::finishRange(uint32_t endBucket)
+{
+	while (m_firstBucket + m_buckets.size() < endBucket)
+		m_buckets.push_back(m_entryNo);
+
+	// not shared writer keeps the whole table till finish
+	if (m_shared)
+	{
+		m_file.seek(indexBucketPos(m_entriesNo, m_firstBucket));
+		m_file.writeVector(m_buckets);
+		startRange(endBucket, m_entryNo);
+	}
+}
+
+uint32_t IndexWriter::bucketsNo() const
+{
+	return m_bucketsNo;
+}
+
+void IndexWriter::setIdsRange(uint32_t firstId, uint32_t endId)
+{
+	m_firstId = firstId;
+	m_endId = endId;
+}
+
+void IndexWriter::setStopGrams(uint32_t stopGrams)
+{
+	m_stopGrams = stopGrams;
+}
+
+void IndexWriter::finish(size_t dataSize)
+{
+	if ((uint64_t) dataSize >= MAX_DATA_SIZE)
+		throw ThisError("database too big");
+
+	if (m_shared && m_entryNo != m_entriesNo)
+		throw ThisError("invalid number of index entries")
+			.add("entries", m_entryNo);
+
+	finishRange(m_bucketsNo + 1);
+	m_file.seek(indexEntryPos(m_entryNo));
+	m_file.writeObj(IndexEntry(0, dataSize, 0));
+
+	if (!m_shared)
+		writeBuckets();
+
+	IndexHeader header;
+	header.magic = INDEX_MAGIC;
+	header.entriesNo = m_entryNo;
+	header.flags = m_flags;
+	header.firstId = m_firstId;
+	header.endId = m_endId;
+	header.stopGrams = m_stopGrams;
+
+	m_file.seek(0);
+	m_file.writeObj(header);
+	m_file.flush();
+}
+
+void IndexWriter::writeBuckets()
+{
+	vector<IndexBucket> buckets;
+	for (uint32_t bucket = 0; bucket < m_bucketsNo; bucket++)
+	{
+		if (m_buckets[bucket] != m_buckets[bucket + 1])
+			buckets.push_back(IndexBucket(bucket, m_buckets[bucket]));
+	}
+
+	if (buckets.size() < indexSparseLimit(m_flags))
+	{
+		buckets.push_back(IndexBucket(m_bucketsNo, m_entryNo));
+		m_file.writeVector(buckets);
+		m_flags |= INDEX_SPARSE_BUCKETS;
+	}
+	else
+	{
+		m_file.writeVector(m_buckets);
+	}
+}
+
+void IndexWriter::renameAndClose(const string &newName)
+{
+	m_file.renameAndClose(newName);
+}
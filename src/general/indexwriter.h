@@ -0,0 +1,66 @@
+#ifndef __INDEX_WRITER_H__
+#define __INDEX_WRITER_H__
+
+#include "index.h"
+#include "file.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+
+/* Writes trigram directory (see IndexTable). Ranges of buckets are written
+ * independently when number of entries preceding them and number of all
+ * entries are known, so single file could be filled by many writers in
+ * parallel. Otherwise ranges are written in order and the bucket table is
+ * kept in memory, finish writes it as sparse one when most buckets are
+ * empty. */
+class IndexWriter
+{
+	public:
+		/** Use "r+b" mode to share existing file with other writers, flags
+		 * are stored in the header (see IndexTable) */
+		IndexWriter(const std::string &fname, uint32_t flags = 0,
+				const char *mode = "wb");
+
+		/** Number of all entries, required to share the file */
+		void setEntriesNo(size_t entriesNo);
+
+		/** Following indexes belong to buckets starting from firstBucket,
+		 * entryNo entries precede them */
+		void startRange(uint32_t firstBucket, size_t entryNo);
+
+		/** Indexes must be written in trigrams order */
+		void write(const Index &index);
+
+		/** Write positions of buckets before endBucket */
+		void finishRange(uint32_t endBucket);
+
+		uint32_t bucketsNo() const;
+
+		/** Range of file IDs and stop-grams threshold stored in the header */
+		void setIdsRange(uint32_t firstId, uint32_t endId);
+		void setStopGrams(uint32_t stopGrams);
+
+		/** Write header and end of data, the last range is finished */
+		void finish(size_t dataSize);
+
+		void renameAndClose(const std::string &newName);
+
+	private:
+		void writeBuckets();
+
+	private:
+		File m_file;
+		std::vector<uint32_t> m_buckets;
+		uint32_t m_flags;
+		uint32_t m_firstId;
+		uint32_t m_endId;
+		uint32_t m_stopGrams;
+		uint32_t m_bucketsNo;
+		uint32_t m_firstBucket;
+		size_t m_entryNo;
+		size_t m_entriesNo;
+		bool m_shared;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "mappedfile.h"
+#include "error.h"
+#include <cstdio>
+#include <cerrno>
+
+#if defined(_POSIX_C_SOURCE) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <csetjmp>
+#include <mutex>
+#endif
+
+using namespace std;
+
+
+MappedFile::MappedFile() : m_data(NULL), m_size(0)
+{}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef HAVE_MMAP
+
+bool MappedFile::open(const string &fname, Access access)
+{
+	close();
+
+	int fd = ::open(fname.c_str(), O_RDONLY);
+	if (fd == -1)
+		throw ThisError("cannot open file", errno).add("file", fname);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		int err = errno;
+		::close(fd);
+		throw ThisError("cannot stat file", err).add("file", fname);
+	}
+
+	// pipes and special files are not mappable
+	if (!S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	if (access == SEQUENTIAL)
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	m_data = (const uint8_t*) data;
+	m_size = st.st_size;
+	m_fname = fname;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data)
+	{
+		munmap((void*) m_data, m_size);
+		m_data = NULL;
+		m_size = 0;
+		m_fname.clear();
+	}
+}
+
+void MappedFile::prefetch(size_t size) const
+{
+	if (m_data)
+		madvise((void*) m_data, size < m_size ? size : m_size, MADV_WILLNEED);
+}
+
+// jump target of guarded thread, SIGBUS is delivered to the faulting one
+static thread_local sigjmp_buf *guardJump = NULL;
+
+static void onBusError(int)
+{
+	if (guardJump)
+		siglongjmp(*guardJump, 1);
+
+	// not a guarded read, faulting instruction crashes as it would without
+	// the handler
+	signal(SIGBUS, SIG_DFL);
+}
+
+bool MappedFile::guard(const function<void ()> &func)
+{
+	static once_flag installed;
+	call_once(installed, []() {
+			struct sigaction action;
+			action.sa_handler = onBusError;
+			action.sa_flags = 0;
+			sigemptyset(&action.sa_mask);
+			sigaction(SIGBUS, &action, NULL);
+		});
+
+	sigjmp_buf jump;
+	if (sigsetjmp(jump, 1) != 0)
+	{
+		guardJump = NULL;
+		return false;
+	}
+
+	guardJump = &jump;
+	func();
+	guardJump = NULL;
+	return true;
+}
+
+#else
+
+bool MappedFile::open(const string &fname, Access access)
+{
+	(void) fname;
+	(void) access;
+	close();
+	return false;
+}
+
+void MappedFile::close()
+{}
+
+void MappedFile::prefetch(size_t size) const
+{
+	(void) size;
+}
+
+bool MappedFile::guard(const function<void ()> &func)
+{
+	func();
+	return true;
+}
+
+#endif
+
+bool MappedFile::isOpen() const
+{
+	return m_data != NULL;
+}
+
+const string &MappedFile::getFileName() const
+{
+	return m_fname;
+}
+
+const uint8_t *MappedFile::data() const
+{
+	return m_data;
+}
+
+size_t MappedFile::size() const
+{
+	return m_size;
+}
@@ -0,0 +1,57 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <string>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+
+/* Read-only memory mapped file. Mapping is available only for regular, non
+ * empty files on POSIX systems - otherwise open() returns false and the file
+ * should be read with File.
+ * Reading pages of file truncated after mapping raises SIGBUS, mapped data
+ * of files that could be modified meanwhile should be read under guard(). */
+class MappedFile
+{
+	public:
+		enum Access
+		{
+			RANDOM,
+			SEQUENTIAL,
+		};
+
+	public:
+		MappedFile();
+		virtual ~MappedFile();
+
+		/** Returns false if file can't be mapped, throws if can't be opened */
+		bool open(const std::string &fname, Access access = RANDOM);
+		void close();
+		bool isOpen() const;
+
+		const std::string &getFileName() const;
+
+		/** Ask system to start reading first size bytes in background */
+		void prefetch(size_t size) const;
+
+		const uint8_t *data() const;
+		size_t size() const;
+
+		/** Call func that reads mapped data. Returns false if func was
+		 * abandoned at read past the end of truncated file, so it must not
+		 * hold locks nor be in the middle of allocation while reading the
+		 * data. Thread safe. */
+		static bool guard(const std::function<void ()> &func);
+
+	private:
+		MappedFile(const MappedFile &);
+		MappedFile &operator= (const MappedFile &);
+
+	private:
+		const uint8_t *m_data;
+		size_t m_size;
+		std::string m_fname;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "node.h"
+#include "query.h"
 #include "case.h"
 #include <cstring>
 #include <cstdio>
@@ -290,63 +291,12 @@ Node *Node::addCommonDescendant(NodePtr desc)
 	return desc.get();
 }
 
-void Node::findIds(Ids &res, DbReader &db) const
+void Node::findIds(Ids &res, DbReader &db, size_t minCandidates,
+		bool caseFolded) const
 {
-	Ids ids;
-	findIds(res, ids, db, 0);
-}
-
-void Node::findIds(Ids &res, const Ids &ids, DbReader &db, uint32_t trigram) const
-{
-	bool gotNewTrigram = false;
-
-	if (val == Node::NODE_END)
-	{
-		res.merge(ids);
-	}
-	else if (val == Node::NODE_SPLIT)
-	{
-		trigram = 0;
-	}
-	else if (val != NODE_EMPTY)
-	{
-		trigram <<= 8;
-		trigram |= val & 0xff;
-		trigram &= 0xffffff;
-		gotNewTrigram = (trigram >= 0x10000);
-	}
-
-	if (gotNewTrigram)
-	{
-		const CompressedIds &cids = db.get(trigram);
-		Ids nodeIds;
-		cids.decompress(nodeIds);
-
-		if (!nodeIds.empty())
-		{
-			if (ids.empty())
-			{
-				for (auto n : next)
-					n->findIds(res, nodeIds, db, trigram);
-			}
-			else
-			{
-				Ids newIds;
-				newIds.commonPart(ids, nodeIds);
-
-				if (!newIds.empty())
-				{
-					for (auto n : next)
-						n->findIds(res, newIds, db, trigram);
-				}
-			}
-		}
-	}
-	else
-	{
-		for (auto n : next)
-			n->findIds(res, ids, db, trigram);
-	}
+	Query query;
+	query.compile(*this, caseFolded);
+	query.findIds(res, db, minCandidates);
 }
 
 // check if there is at least three consecutive characters to generate trigram
@@ -31,7 +31,11 @@ class Node
 		void parseRegex(const std::string &exp, bool extended, bool caseSensitive);
 
 		bool isUnambiguous(unsigned charsNo = 0) const;
-		void findIds(Ids &res, DbReader &db) const;
+		/** Intersecting trigram lists stops when at most minCandidates files
+		 * are left, case-folded trigrams are used if caseFolded is set, see
+		 * Query */
+		void findIds(Ids &res, DbReader &db, size_t minCandidates = 0,
+				bool caseFolded = false) const;
 
 		const std::list<NodePtr> &getNext() const;
 		int getVal() const;
@@ -50,8 +54,6 @@ class Node
 		void markAlpha();
 		void permuteCaseMarked();
 
-		void findIds(Ids &res, const Ids &ids, DbReader &db, uint32_t trigram) const;
-
 		Node *addNext(int val = NODE_EMPTY);
 		Node *addCommonDescendant(NodePtr desc);
 
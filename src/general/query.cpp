@@ -0,0 +1,349 @@
+#include "query.h"
+#include "node.h"
+#include "index.h"
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+
+using namespace std;
+
+
+Query::Query() : m_root(NULL), m_caseFolded(false)
+{
+	Exprs noChildren;
+	m_none = make(Expr::NONE, noChildren);
+	m_all = make(Expr::ALL, noChildren);
+}
+
+void Query::compile(const Node &node, bool caseFolded)
+{
+	m_caseFolded = caseFolded;
+	m_root = compile(&node, 0, false);
+	m_compiled.clear();
+}
+
+/* Trigram holds the last characters of path, the same as in Node graph walk.
+ * Path without any trigram found matches nothing at its end. */
+const Query::Expr *Query::compile(const Node *node, uint32_t trigram,
+		bool found)
+{
+	int val = node->getVal();
+	bool gotNewTrigram = false;
+
+	if (val == Node::NODE_END)
+	{
+		// path could be continued, but it would only narrow the result
+		if (found)
+			return m_all;
+	}
+	else if (val == Node::NODE_SPLIT)
+	{
+		trigram = 0;
+	}
+	else if (val != Node::NODE_EMPTY)
+	{
+		trigram <<= 8;
+		trigram |= val & 0xff;
+		trigram &= 0xffffff;
+		gotNewTrigram = (trigram >= 0x10000);
+		found |= gotNewTrigram;
+	}
+
+	// following trigrams depend only on the last two characters
+	auto key = make_pair(node, (trigram & 0xffff) | (found ? 0x10000 : 0));
+	auto it = m_compiled.find(key);
+	const Expr *next;
+
+	if (it != m_compiled.end())
+	{
+		next = it->second;
+	}
+	else
+	{
+		Exprs alternatives;
+		for (auto &n : node->getNext())
+			alternatives.push_back(compile(n.get(), trigram, found));
+
+		next = makeOr(alternatives);
+		m_compiled[key] = next;
+	}
+
+	return gotNewTrigram ? makeAnd({ makeTrigram(trigram), next }) : next;
+}
+
+const Query::Expr *Query::makeTrigram(uint32_t trigram)
+{
+	if (m_caseFolded)
+		trigram = foldTrigram(trigram);
+
+	auto it = m_trigrams.find(trigram);
+	if (it != m_trigrams.end())
+		return it->second;
+
+	Expr *expr = new Expr();
+	m_exprs.emplace_back(expr);
+
+	expr->type = Expr::TRIGRAM;
+	expr->trigram = trigram;
+	m_trigrams[trigram] = expr;
+	return expr;
+}
+
+const Query::Expr *Query::makeAnd(const Exprs &children)
+{
+	Exprs operands;
+
+	for (const Expr *child : children)
+	{
+		if (child->type == Expr::NONE)
+			return m_none;
+		else if (child->type == Expr::AND)
+			operands.insert(operands.end(), child->children.begin(),
+					child->children.end());
+		else if (child->type != Expr::ALL)
+			operands.push_back(child);
+	}
+
+	sort(operands.begin(), operands.end());
+	operands.erase(unique(operands.begin(), operands.end()), operands.end());
+
+	if (operands.empty())
+		return m_all;
+	else if (operands.size() == 1)
+		return operands[0];
+
+	return make(Expr::AND, operands);
+}
+
+// trigrams required by expression itself, sorted
+void Query::requiredTrigrams(const Expr *expr, Exprs &trigrams)
+{
+	trigrams.clear();
+
+	if (expr->type == Expr::TRIGRAM)
+	{
+		trigrams.push_back(expr);
+	}
+	else if (expr->type == Expr::AND)
+	{
+		for (const Expr *child : expr->children)
+		{
+			if (child->type == Expr::TRIGRAM)
+				trigrams.push_back(child);
+		}
+	}
+}
+
+const Query::Expr *Query::makeOr(const Exprs &children)
+{
+	Exprs operands;
+
+	for (const Expr *child : children)
+	{
+		if (child->type == Expr::ALL)
+			return m_all;
+		else if (child->type == Expr::OR)
+			operands.insert(operands.end(), child->children.begin(),
+					child->children.end());
+		else if (child->type != Expr::NONE)
+			operands.push_back(child);
+	}
+
+	sort(operands.begin(), operands.end());
+	operands.erase(unique(operands.begin(), operands.end()), operands.end());
+
+	if (operands.empty())
+		return m_none;
+	else if (operands.size() == 1)
+		return operands[0];
+
+	// trigrams required by every alternative are moved out of them
+	Exprs common, trigrams, res;
+	requiredTrigrams(operands[0], common);
+
+	for (size_t i = 1; i < operands.size() && !common.empty(); i++)
+	{
+		requiredTrigrams(operands[i], trigrams);
+		res.clear();
+		set_intersection(common.begin(), common.end(),
+				trigrams.begin(), trigrams.end(), back_inserter(res));
+		common.swap(res);
+	}
+
+	if (common.empty())
+		return make(Expr::OR, operands);
+
+	Exprs rest;
+	for (const Expr *operand : operands)
+	{
+		if (operand->type == Expr::TRIGRAM)
+			return makeAnd(common);
+
+		res.clear();
+		set_difference(operand->children.begin(), operand->children.end(),
+				common.begin(), common.end(), back_inserter(res));
+		rest.push_back(makeAnd(res));
+	}
+
+	common.push_back(makeOr(rest));
+	return makeAnd(common);
+}
+
+const Query::Expr *Query::make(Expr::Type type, const Exprs &children)
+{
+	auto key = make_pair(type, children);
+	auto it = m_shared.find(key);
+	if (it != m_shared.end())
+		return it->second;
+
+	Expr *expr = new Expr();
+	m_exprs.emplace_back(expr);
+
+	expr->type = type;
+	expr->trigram = 0;
+	expr->children = children;
+	m_shared[key] = expr;
+	return expr;
+}
+
+void Query::findIds(Ids &res, DbReader &db, size_t minCandidates)
+{
+	// query without trigrams could not be answered by the index
+	if (m_root == NULL || m_root->type == Expr::ALL ||
+			m_root->type == Expr::NONE)
+	{
+		return;
+	}
+
+	QueryCache cache(db);
+	res.merge(evaluate(m_root, cache, minCandidates));
+
+	m_results.clear();
+	m_costs.clear();
+}
+
+// upper bound of result size, in bytes of trigram lists
+size_t Query::estimateCost(const Expr *expr, QueryCache &cache)
+{
+	if (expr->type == Expr::TRIGRAM)
+		return cache.getSize(expr->trigram);
+
+	auto it = m_costs.find(expr);
+	if (it != m_costs.end())
+		return it->second;
+
+	size_t cost = expr->type == Expr::AND ? SIZE_MAX : 0;
+
+	for (const Expr *child : expr->children)
+	{
+		if (expr->type == Expr::AND)
+			cost = min(cost, estimateCost(child, cache));
+		else
+			cost += estimateCost(child, cache);
+	}
+
+	m_costs[expr] = cost;
+	return cost;
+}
+
+const Ids &Query::evaluate(const Expr *expr, QueryCache &cache,
+		size_t minCandidates)
+{
+	if (expr->type == Expr::TRIGRAM)
+		return cache.get(expr->trigram);
+
+	auto it = m_results.find(expr);
+	if (it != m_results.end())
+		return it->second;
+
+	Ids &res = m_results[expr];
+
+	if (expr->type == Expr::OR)
+	{
+		for (const Expr *child : expr->children)
+			res.merge(evaluate(child, cache, minCandidates));
+	}
+	else if (expr->type == Expr::AND)
+	{
+		vector<pair<size_t, const Expr*>> operands;
+		for (const Expr *child : expr->children)
+			operands.push_back(make_pair(estimateCost(child, cache), child));
+
+		stable_sort(operands.begin(), operands.end(),
+				[](const pair<size_t, const Expr*> &a,
+					const pair<size_t, const Expr*> &b) {
+					return a.first < b.first;
+				});
+
+		// candidates are copied once, then narrowed in place
+		const Ids *ids = &evaluate(operands[0].second, cache, minCandidates);
+
+		for (size_t i = 1; i < operands.size(); i++)
+		{
+			// remaining candidates are cheaper to verify than to decode lists
+			if (ids->empty() || ids->size() <= minCandidates)
+				break;
+
+			const Expr *operand = operands[i].second;
+
+			if (operand->type == Expr::TRIGRAM)
+			{
+				if (ids != &res)
+					res = *ids;
+
+				cache.commonPart(operand->trigram, res);
+			}
+			else
+			{
+				res.commonPart(*ids, evaluate(operand, cache, minCandidates));
+			}
+
+			ids = &res;
+		}
+
+		if (ids != &res)
+			res = *ids;
+	}
+
+	return res;
+}
+
+string Query::toString() const
+{
+	return m_root ? toString(m_root) : string();
+}
+
+string Query::toString(const Expr *expr) const
+{
+	switch (expr->type)
+	{
+		case Expr::NONE:
+			return "NONE";
+
+		case Expr::ALL:
+			return "ALL";
+
+		case Expr::TRIGRAM:
+		{
+			char buf[8];
+			snprintf(buf, sizeof(buf), "%06x", expr->trigram);
+			return buf;
+		}
+
+		default:
+			break;
+	}
+
+	// children are ordered by address, so they are sorted for stable output
+	vector<string> children;
+	for (const Expr *child : expr->children)
+		children.push_back(toString(child));
+
+	sort(children.begin(), children.end());
+
+	string res = expr->type == Expr::AND ? "AND(" : "OR(";
+	for (size_t i = 0; i < children.size(); i++)
+		res += (i ? " " : "") + children[i];
+
+	return res + ")";
+}
@@ -0,0 +1,89 @@
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+#include "dbreader.h"
+#include "querycache.h"
+#include "ids.h"
+#include <vector>
+#include <map>
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+
+class Node;
+
+
+/* Boolean trigram query compiled from Node graph: trigrams found along path
+ * are ANDed, alternative paths are ORed. Expressions are normalized - nested
+ * operations are flattened, duplicates removed and trigrams common to all
+ * alternatives hoisted - and identical ones are shared, so every one is
+ * evaluated once. Operands of AND are intersected from the cheapest one,
+ * estimated by sizes of trigram lists. Candidates left are looked up in
+ * trigram lists of further operands, instead of decoding them. */
+class Query
+{
+	public:
+		Query();
+
+		/** With caseFolded set case-folded trigrams are looked up, so graph
+		 * of case insensitive pattern does not need letter case permuted */
+		void compile(const Node &node, bool caseFolded = false);
+
+		/** Files matching query are added to res. Intersecting stops when at
+		 * most minCandidates files are left, they have to be verified anyway,
+		 * 0 gives exact result */
+		void findIds(Ids &res, DbReader &db, size_t minCandidates = 0);
+
+		/* debug method */
+		std::string toString() const;
+
+	private:
+		struct Expr
+		{
+			enum Type
+			{
+				NONE,		// no file matches
+				ALL,		// every file matches
+				TRIGRAM,
+				AND,
+				OR,
+			};
+
+			Type type;
+			uint32_t trigram;
+			std::vector<const Expr*> children;
+		};
+
+		typedef std::vector<const Expr*> Exprs;
+
+		const Expr *compile(const Node *node, uint32_t trigram, bool found);
+
+		const Expr *makeTrigram(uint32_t trigram);
+		const Expr *makeAnd(const Exprs &children);
+		const Expr *makeOr(const Exprs &children);
+		const Expr *make(Expr::Type type, const Exprs &children);
+
+		static void requiredTrigrams(const Expr *expr, Exprs &trigrams);
+
+		size_t estimateCost(const Expr *expr, QueryCache &cache);
+		const Ids &evaluate(const Expr *expr, QueryCache &cache,
+				size_t minCandidates);
+
+		std::string toString(const Expr *expr) const;
+
+	private:
+		const Expr *m_root;
+		bool m_caseFolded;
+		const Expr *m_none;
+		const Expr *m_all;
+
+		std::vector<std::unique_ptr<Expr>> m_exprs;
+		std::map<uint32_t, const Expr*> m_trigrams;
+		std::map<std::pair<Expr::Type, Exprs>, const Expr*> m_shared;
+		std::map<std::pair<const Node*, uint32_t>, const Expr*> m_compiled;
+		std::map<const Expr*, Ids> m_results;
+		std::map<const Expr*, size_t> m_costs;
+};
+
+#endif
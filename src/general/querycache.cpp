@@ -0,0 +1,38 @@
+#include "querycache.h"
+
+using namespace std;
+
+
+QueryCache::QueryCache(DbReader &db) : m_db(db)
+{}
+
+const Ids &QueryCache::get(uint32_t trigram)
+{
+	auto it = m_lists.find(trigram);
+	if (it != m_lists.end())
+		return it->second;
+
+	Ids &ids = m_lists[trigram];
+	m_db.get(trigram).decompress(ids);
+	return ids;
+}
+
+void QueryCache::commonPart(uint32_t trigram, Ids &ids)
+{
+	auto it = m_lists.find(trigram);
+	if (it != m_lists.end())
+	{
+		ids.commonPart(it->second);
+		return;
+	}
+
+	if (m_db.isStopGram(trigram))
+		m_db.getComplement(trigram).excludeFrom(ids);
+	else
+		m_db.get(trigram).commonPart(ids);
+}
+
+size_t QueryCache::getSize(uint32_t trigram) const
+{
+	return m_db.getSize(trigram);
+}
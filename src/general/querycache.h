@@ -0,0 +1,34 @@
+#ifndef __QUERY_CACHE_H__
+#define __QUERY_CACHE_H__
+
+#include "dbreader.h"
+#include "ids.h"
+#include <map>
+#include <stdint.h>
+
+
+/* Lists decoded while evaluating single query, every trigram is decoded
+ * once. Returned lists are valid as long as the cache. */
+class QueryCache
+{
+	public:
+		QueryCache(DbReader &db);
+
+		/** Decoded list of trigram */
+		const Ids &get(uint32_t trigram);
+
+		/** Leave in ids only IDs present in trigram list. Already decoded
+		 * list is intersected, otherwise the compressed one is merged with
+		 * ids in place, without decoding it. Complement list of stop-gram
+		 * is subtracted from ids instead. */
+		void commonPart(uint32_t trigram, Ids &ids);
+
+		/** Size of trigram list in bytes, the list is not read */
+		size_t getSize(uint32_t trigram) const;
+
+	private:
+		DbReader &m_db;
+		std::map<uint32_t, Ids> m_lists;
+};
+
+#endif
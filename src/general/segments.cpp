@@ -0,0 +1,94 @@
+#include "segments.h"
+#include "config.h"
+#include "dir.h"
+#include "file.h"
+#include <algorithm>
+
+using namespace std;
+
+
+static string segmentPath(const string &dir, const char *path, uint32_t segment)
+{
+	string res = dir + PATH_DELIMITER + path;
+	if (segment > 0)
+		res += "." + to_string(segment);
+	return res;
+}
+
+
+void Segments::read(const string &dir)
+{
+	uint64_t size;
+	int64_t mtime;
+
+	if (getFileInfo(dir + PATH_DELIMITER + SEGMENTS_PATH, size, mtime))
+		File(dir + PATH_DELIMITER + SEGMENTS_PATH, "rb").readVector(m_segments);
+	else
+		m_segments.assign(1, 0);
+}
+
+void Segments::write(const string &dir) const
+{
+	File file(dir + PATH_DELIMITER + SEGMENTS_PATH_TMP, "wb");
+	file.writeVector(m_segments);
+	file.renameAndClose(dir + PATH_DELIMITER + SEGMENTS_PATH);
+}
+
+uint32_t Segments::newSegment() const
+{
+	if (m_segments.empty())
+		return 0;
+
+	return *max_element(m_segments.begin(), m_segments.end()) + 1;
+}
+
+void Segments::add(uint32_t segment)
+{
+	m_segments.push_back(segment);
+}
+
+void Segments::replace(size_t pos, size_t no, uint32_t segment)
+{
+	m_segments.erase(m_segments.begin() + pos, m_segments.begin() + pos + no);
+	m_segments.insert(m_segments.begin() + pos, segment);
+}
+
+void Segments::clear()
+{
+	m_segments.clear();
+}
+
+uint32_t Segments::get(size_t pos) const
+{
+	return m_segments[pos];
+}
+
+size_t Segments::size() const
+{
+	return m_segments.size();
+}
+
+bool Segments::empty() const
+{
+	return m_segments.empty();
+}
+
+string Segments::indexPath(const string &dir, uint32_t segment)
+{
+	return segmentPath(dir, TRIGRAMS_LIST_PATH, segment);
+}
+
+string Segments::dataPath(const string &dir, uint32_t segment)
+{
+	return segmentPath(dir, TRIGRAMS_DATA_PATH, segment);
+}
+
+Segments::const_iterator Segments::begin() const
+{
+	return m_segments.begin();
+}
+
+Segments::const_iterator Segments::end() const
+{
+	return m_segments.end();
+}
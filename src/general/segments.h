@@ -0,0 +1,46 @@
+#ifndef __SEGMENTS_H__
+#define __SEGMENTS_H__
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+
+/* List of database segments. Every segment is separate index and data files
+ * pair covering range of file IDs, segments are ordered by these ranges.
+ * Segment 0 uses base index and data file names, other ones have segment
+ * number appended. Database without segments list has only segment 0. */
+class Segments
+{
+	public:
+		void read(const std::string &dir);
+
+		/** Atomically replace segments list */
+		void write(const std::string &dir) const;
+
+		/** Number not used by any segment */
+		uint32_t newSegment() const;
+
+		void add(uint32_t segment);
+
+		/** Replace no segments starting from pos with single one */
+		void replace(size_t pos, size_t no, uint32_t segment);
+
+		void clear();
+
+		uint32_t get(size_t pos) const;
+		size_t size() const;
+		bool empty() const;
+
+		static std::string indexPath(const std::string &dir, uint32_t segment);
+		static std::string dataPath(const std::string &dir, uint32_t segment);
+
+		typedef std::vector<uint32_t>::const_iterator const_iterator;
+		const_iterator begin() const;
+		const_iterator end() const;
+
+	private:
+		std::vector<uint32_t> m_segments;
+};
+
+#endif
@@ -22,6 +22,11 @@ extern "C" {
 using namespace std;
 
 
+// candidate files are grepped anyway, so that many of them are not narrowed
+// down further by the index
+#define VERIFIED_CANDIDATES_NO	16
+
+
 enum
 {
 	COLOR_OPTION = CHAR_MAX + 1,
@@ -283,22 +288,30 @@ int main(int argc, char * const argv[])
 			dumpDb(database, dumpDbPath);
 		}
 
+		// case insensitive query is linear in pattern length with folded
+		// trigrams, otherwise every letter case combination is looked up
+		bool caseFolded = !caseSensitivePatterns && database.isCaseFolded();
+
 		for (const string &pattern : patterns)
 		{
 			Pattern *p = Pattern::create(pattern, mode, caseSensitivePatterns);
 			grep.addPattern(p);
-			p->tokenize(tree);
+			p->tokenize(tree, caseFolded);
 		}
 
 		if (dotGraphPath)
 			saveDotGraph(&tree, dotGraphPath);
 
-		tree.findIds(ids, database);
+		tree.findIds(ids, database, listOnly ? 0 : VERIFIED_CANDIDATES_NO,
+				caseFolded);
 		bool found = false;
 
 		for (auto id : ids)
 		{
 			string filePath = database.getFile(id);
+			if (filePath.empty())
+				continue; // file removed from index
+
 			if (!isAbsolutePath(filePath))
 				filePath = string(dbdir + PATH_DELIMITER) + filePath;
 			canonizePath(filePath);
@@ -374,14 +387,17 @@ void dumpDb(DbReader &db, const string &fname)
 	else
 		dst.open(fname, "wb");
 
-	for (const Index &index : db.getIndexes())
+	for (uint32_t trigram : db.getTrigrams())
 	{
-		const CompressedIds &ids = db.get(index.trigram);
+		const CompressedIds &ids = db.get(trigram);
 		for (CompressedIds::iterator it = ids.begin(); !it.end(); ++it)
 		{
+			if (db.getFile(*it).empty())
+				continue;
+
 			stringstream line;
 			line << std::setfill('0') << std::setw(6) << std::hex
-				<< index.trigram << ' ' << db.getFile(*it);
+				<< trigram << ' ' << db.getFile(*it);
 			dst.writeLine(line.str());
 		}
 		db.clearCache();
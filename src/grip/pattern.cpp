@@ -25,7 +25,7 @@ class LiteralPattern : public Pattern
 		virtual ~LiteralPattern()
 		{}
 
-		virtual void tokenize(Node &tree) const
+		virtual void tokenize(Node &tree, bool /*caseFolded*/) const
 		{
 			tree.parseFixedString(m_pattern, true);
 		}
@@ -58,9 +58,9 @@ class LiteralCaseInsPattern : public Pattern
 		virtual ~LiteralCaseInsPattern()
 		{}
 
-		virtual void tokenize(Node &tree) const
+		virtual void tokenize(Node &tree, bool caseFolded) const
 		{
-			tree.parseFixedString(m_pattern, false);
+			tree.parseFixedString(m_pattern, caseFolded);
 		}
 
 		virtual Match match(const char *str) const
@@ -115,9 +115,10 @@ class RegexPattern : public Pattern
 			regfree(&m_regex);
 		}
 
-		virtual void tokenize(Node &tree) const
+		virtual void tokenize(Node &tree, bool caseFolded) const
 		{
-			tree.parseRegex(m_pattern, m_extended, m_caseSensitive);
+			tree.parseRegex(m_pattern, m_extended,
+					m_caseSensitive || caseFolded);
 		}
 
 		virtual Match match(const char *str) const
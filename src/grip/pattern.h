@@ -25,7 +25,9 @@ class Pattern
 
 	public:
 		virtual ~Pattern();
-		virtual void tokenize(Node &tree) const = 0;
+		/** Letter case is not permuted if the tree is looked up by
+		 * case-folded trigrams */
+		virtual void tokenize(Node &tree, bool caseFolded) const = 0;
 		virtual Match match(const char *str) const = 0;
 
 		Match matchWord(const char *str) const;
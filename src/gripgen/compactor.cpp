@@ -0,0 +1,294 @@
+#include "compactor.h"
+#include "compressedids.h"
+#include "filelist.h"
+#include "index.h"
+#include "indextable.h"
+#include "indexwriter.h"
+#include "file.h"
+#include "config.h"
+#include "dir.h"
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+
+
+// older segment joins the run if it is at most that many times bigger
+#define TIER_RATIO	2
+
+
+Compactor::Compactor(const string &dir)
+	: m_dir(dir)
+{
+	m_segments.read(dir);
+
+	for (uint32_t segment : m_segments)
+	{
+		uint64_t size;
+		int64_t mtime;
+
+		if (!getFileInfo(Segments::dataPath(dir, segment), size, mtime))
+		{
+			throw ThisError("malformed database, missing segment")
+				.add("segment", segment);
+		}
+
+		m_sizes.push_back(size);
+	}
+
+	Files files;
+	files.read(dir + PATH_DELIMITER + FILE_LIST_PATH);
+
+	m_removed.resize(files.size());
+	for (uint32_t id = 0; id < files.size(); id++)
+		m_removed[id] = files.get(id).empty();
+}
+
+size_t Compactor::segmentsNo() const
+{
+	return m_segments.size();
+}
+
+size_t Compactor::size() const
+{
+	size_t size = 0;
+	for (size_t segmentSize : m_sizes)
+		size += segmentSize;
+
+	return size;
+}
+
+size_t Compactor::compact(bool all)
+{
+	size_t pos = 0;
+	size_t no = all ? m_segments.size() : selectSegments(pos);
+
+	if (no < 2 && !(all && no == 1))
+		return 0;
+
+	uint32_t segment = m_segments.newSegment();
+	size_t size = mergeSegments(pos, no, segment);
+
+	vector<uint32_t> merged(m_segments.begin() + pos,
+			m_segments.begin() + pos + no);
+
+	m_segments.replace(pos, no, segment);
+	m_segments.write(m_dir);
+
+	m_sizes.erase(m_sizes.begin() + pos, m_sizes.begin() + pos + no);
+	m_sizes.insert(m_sizes.begin() + pos, size);
+
+	for (uint32_t oldSegment : merged)
+	{
+		File::remove(Segments::indexPath(m_dir, oldSegment), true);
+		File::remove(Segments::dataPath(m_dir, oldSegment), true);
+	}
+
+	return no;
+}
+
+size_t Compactor::selectSegments(size_t &pos) const
+{
+	// newest run of segments of similar size
+	for (size_t end = m_segments.size(); end >= 2; end--)
+	{
+		size_t begin = end - 1;
+		size_t size = m_sizes[begin];
+
+		while (begin > 0 && m_sizes[begin - 1] <= TIER_RATIO * size)
+			size += m_sizes[--begin];
+
+		if (end - begin >= 2)
+		{
+			pos = begin;
+			return end - begin;
+		}
+	}
+
+	return 0;
+}
+
+size_t Compactor::mergeSegments(size_t pos, size_t no, uint32_t segment)
+{
+	struct Source
+	{
+		IndexTable indexes;
+		IndexTable::iterator next;
+		File dataFile;
+		CompressedIds::Format format;
+	};
+
+	vector<unique_ptr<Source>> sources;
+
+	// case-folded trigrams and block lists are kept only if every segment
+	// has them, the same goes for stop-grams with the lowest threshold
+	uint32_t flags = INDEX_CASE_FOLDED | INDEX_BLOCK_LISTS;
+	uint32_t stopGrams = 0;
+
+	for (size_t i = pos; i < pos + no; i++)
+	{
+		Source *source = new Source();
+		sources.emplace_back(source);
+
+		uint32_t oldSegment = m_segments.get(i);
+		source->indexes.read(Segments::indexPath(m_dir, oldSegment));
+		source->next = source->indexes.begin();
+		source->dataFile.open(Segments::dataPath(m_dir, oldSegment), "rb");
+		source->format = source->indexes.flags() & INDEX_BLOCK_LISTS ?
+			CompressedIds::BLOCKS : CompressedIds::VARINT;
+		flags &= source->indexes.flags();
+
+		if (i == pos)
+			stopGrams = source->indexes.stopGrams();
+		else
+			stopGrams = min(stopGrams, source->indexes.stopGrams());
+	}
+
+	// segments cover consecutive ranges of IDs
+	uint32_t firstId = sources.front()->indexes.firstId();
+	uint32_t endId = sources.back()->indexes.endId();
+
+	size_t filesNo = 0;
+	for (uint32_t id = firstId; id < endId; id++)
+	{
+		if (!isRemoved(id))
+			filesNo++;
+	}
+
+	string idxPath = Segments::indexPath(m_dir, segment);
+	string dataPath = Segments::dataPath(m_dir, segment);
+	IndexWriter idxFile(idxPath + TMP_SUFFIX, flags);
+	idxFile.setIdsRange(firstId, endId);
+	idxFile.setStopGrams(stopGrams);
+	File dataFile(dataPath + TMP_SUFFIX, "wb");
+
+	vector<uint8_t> buffer;
+	vector<uint8_t> blocks;
+	CompressedIds ids;
+	CompressedIds complement;
+
+	Index index;
+	index.offset = 0;
+
+	while (true)
+	{
+		// lowest trigram of all sources
+		uint32_t trigram = 0xffffffff;
+		for (auto &source : sources)
+		{
+			if (!source->next.end())
+				trigram = min(trigram, source->next->trigram);
+		}
+
+		// folded trigrams follow all exact ones
+		if (trigram == 0xffffffff ||
+				(trigram >= TRIGRAM_FOLDED && !(flags & INDEX_CASE_FOLDED)))
+		{
+			break;
+		}
+
+		// sources are ordered by IDs, so lists are just concatenated
+		ids.clear();
+		size_t idsNo = 0;
+
+		for (auto &source : sources)
+		{
+			if (source->next.end())
+				continue;
+
+			const Index &idx = *source->next;
+			if (idx.trigram != trigram)
+				continue;
+
+			buffer.resize(idx.size);
+			source->dataFile.seek(idx.offset);
+			source->dataFile.read(buffer.data(), idx.size);
+
+			CompressedIds::iterator it(buffer.data(), idx.size,
+					source->format);
+
+			if (idx.complement)
+			{
+				idsNo += addComplement(it, source->indexes.firstId(),
+						source->indexes.endId(), ids);
+			}
+			else
+			{
+				for (; !it.end(); ++it)
+				{
+					uint32_t id = *it;
+					if (!isRemoved(id))
+					{
+						ids.add(id);
+						idsNo++;
+					}
+				}
+			}
+
+			++source->next;
+		}
+
+		if (ids.empty())
+			continue;
+
+		index.complement = stopGrams > 0 &&
+			(uint64_t) idsNo * 100 > (uint64_t) stopGrams * filesNo;
+
+		if (index.complement)
+		{
+			CompressedIds::iterator it = ids.begin();
+			complement.clear();
+			addComplement(it, firstId, endId, complement);
+			ids.swap(complement);
+		}
+
+		const uint8_t *data = ids.getData();
+		index.size = ids.size();
+
+		if (flags & INDEX_BLOCK_LISTS && index.size > 0)
+		{
+			CompressedIds::toBlocks(data, index.size, blocks);
+			data = blocks.data();
+			index.size = blocks.size();
+		}
+
+		index.trigram = trigram;
+		index.lastId = ids.lastId();
+
+		dataFile.write(data, index.size);
+		idxFile.write(index);
+		index.offset += index.size;
+	}
+
+	idxFile.finish(index.offset);
+	idxFile.renameAndClose(idxPath);
+	dataFile.renameAndClose(dataPath);
+	return index.offset;
+}
+
+/* Adds IDs of range that are neither on the list nor removed, returns their
+ * number */
+size_t Compactor::addComplement(CompressedIds::iterator &it, uint32_t firstId,
+		uint32_t endId, CompressedIds &ids) const
+{
+	size_t no = 0;
+
+	for (uint32_t id = firstId; id < endId; id++)
+	{
+		while (!it.end() && *it < id)
+			++it;
+
+		if ((it.end() || *it != id) && !isRemoved(id))
+		{
+			ids.add(id);
+			no++;
+		}
+	}
+
+	return no;
+}
+
+bool Compactor::isRemoved(uint32_t id) const
+{
+	return id < m_removed.size() && m_removed[id];
+}
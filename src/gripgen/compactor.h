@@ -0,0 +1,44 @@
+#ifndef __COMPACTOR_H__
+#define __COMPACTOR_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "segments.h"
+#include "compressedids.h"
+
+
+/* Merges database segments into one. Segments are selected by size tiers:
+ * run of the newest segments is extended with older one as long as it is
+ * not much larger than the run. IDs of removed files are dropped from the
+ * merged lists. Lists of stop-grams are stored as complements when every
+ * merged segment has stop-grams threshold set (see IndexTable). */
+class Compactor
+{
+	public:
+		Compactor(const std::string &dir = ".");
+
+		size_t segmentsNo() const;
+
+		/** Total size of segments data */
+		size_t size() const;
+
+		/** Merge segments of similar size or all of them. Returns number of
+		 * merged segments, 0 if there was nothing to merge */
+		size_t compact(bool all = false);
+
+	private:
+		size_t selectSegments(size_t &pos) const;
+		size_t mergeSegments(size_t pos, size_t no, uint32_t segment);
+		size_t addComplement(CompressedIds::iterator &it, uint32_t firstId,
+				uint32_t endId, CompressedIds &ids) const;
+		bool isRemoved(uint32_t id) const;
+
+	private:
+		std::string m_dir;
+		Segments m_segments;
+		std::vector<size_t> m_sizes;
+		std::vector<bool> m_removed;
+};
+
+#endif
@@ -0,0 +1,534 @@
+#include "dbwriter.h"
+#include "index.h"
+#include "indextable.h"
+#include "filetable.h"
+#include "fileline.h"
+#include "dir.h"
+#include "config.h"
+#include "compressedids.h"
+#include "segments.h"
+#include "sortdb.h"
+#include "compactor.h"
+#include "error.h"
+#include <algorithm>
+#include <ctime>
+
+using namespace std;
+
+
+#define COPY_BUFFER_SIZE	(4 * 1024 * 1024)
+#define SORT_BUFFER_SIZE	(64 * 1024 * 1024)
+
+
+DbWriter::DbWriter() : m_timestamp(0), m_flags(0), m_stopGrams(0),
+	m_update(false),
+	m_oldTimestamp(0), m_keptFilesNo(0), m_oldMemoryUsage(0), m_fileId(0),
+	m_chunksNo(0), m_chunksSize(0),
+	m_sortBufferSize(SORT_BUFFER_SIZE)
+{}
+
+bool DbWriter::open(const string &dir, bool update)
+{
+	m_dir = dir;
+	m_timestamp = time(NULL);
+
+	makeDirectory(dir + PATH_DELIMITER + GRIP_DIR);
+	m_idxFile.open(dir + PATH_DELIMITER + CHUNKS_LIST_PATH, "w+b");
+	m_dataFile.open(dir + PATH_DELIMITER + CHUNKS_DATA_PATH, "w+b");
+	m_filesFile.open(dir + PATH_DELIMITER + CHUNKS_FILES_PATH, "w+b");
+	m_metaFile.open(dir + PATH_DELIMITER + CHUNKS_META_PATH, "w+b");
+
+	// header is filled when the list is complete
+	FilesMetaHeader header = {0, 0, 0};
+	m_metaFile.writeObj(header);
+
+	bool res = update ? openDatabase() : true;
+	m_partitions.assign(partitionsNo(m_flags), SortedRuns());
+	return res;
+}
+
+void DbWriter::setCaseFolded(bool folded)
+{
+	if (folded)
+		m_flags |= INDEX_CASE_FOLDED;
+	else
+		m_flags &= ~INDEX_CASE_FOLDED;
+}
+
+bool DbWriter::isCaseFolded() const
+{
+	return m_flags & INDEX_CASE_FOLDED;
+}
+
+void DbWriter::setListFormat(CompressedIds::Format format)
+{
+	if (format == CompressedIds::BLOCKS)
+		m_flags |= INDEX_BLOCK_LISTS;
+	else
+		m_flags &= ~INDEX_BLOCK_LISTS;
+}
+
+CompressedIds::Format DbWriter::getListFormat() const
+{
+	return m_flags & INDEX_BLOCK_LISTS ?
+		CompressedIds::BLOCKS : CompressedIds::VARINT;
+}
+
+void DbWriter::setStopGrams(unsigned percent)
+{
+	m_stopGrams = percent;
+}
+
+unsigned DbWriter::getStopGrams() const
+{
+	return m_stopGrams;
+}
+
+bool DbWriter::openDatabase()
+{
+	string dir = m_dir + PATH_DELIMITER;
+	uint64_t size;
+	int64_t mtime;
+
+	// database created by older version
+	if (!getFileInfo(dir + FILES_META_PATH, size, mtime))
+		return false;
+
+	if (!readDatabaseFlags())
+		return false;
+
+	FilesMetaHeader header;
+	File metaFile(dir + FILES_META_PATH, "rb");
+	metaFile.readObj(header);
+	metaFile.readVector(m_oldMeta, (size_t) header.filesNo);
+
+	m_oldFiles.read(dir + FILE_LIST_PATH);
+	if (m_oldFiles.size() != header.filesNo)
+	{
+		m_oldFiles.clear();
+		m_oldMeta.clear();
+		return false;
+	}
+
+	m_oldTimestamp = header.timestamp;
+	m_keptFiles.assign(header.filesNo, false);
+
+	m_oldMemoryUsage = m_oldMeta.size() * sizeof(FileMeta)
+		+ m_keptFiles.size() / 8;
+
+	for (uint32_t id = 0; id < m_oldFiles.size(); id++)
+	{
+		const string &name = m_oldFiles.get(id);
+		if (!name.empty())
+			m_oldIds[name] = id;
+
+		// name is stored twice: on the list and as the hash map key, map node
+		// is approximated by the key, ID and two pointers
+		m_oldMemoryUsage += 2 * (sizeof(string) + name.capacity())
+			+ sizeof(uint32_t) + 2 * sizeof(void*);
+	}
+
+	m_fileId = m_oldFiles.size();
+	m_update = true;
+	return true;
+}
+
+/* New segment must store trigrams the same way as existing ones */
+bool DbWriter::readDatabaseFlags()
+{
+	Segments segments;
+	segments.read(m_dir);
+
+	uint32_t flags = INDEX_CASE_FOLDED | INDEX_BLOCK_LISTS;
+	uint32_t stopGrams = 0;
+
+	try
+	{
+		for (uint32_t segment : segments)
+		{
+			IndexTable indexes;
+			indexes.read(Segments::indexPath(m_dir, segment));
+			flags &= indexes.flags();
+
+			// segments could differ after compaction, the lowest is kept
+			if (segment == *segments.begin())
+				stopGrams = indexes.stopGrams();
+			else
+				stopGrams = min(stopGrams, indexes.stopGrams());
+		}
+	}
+	catch (const Error &)
+	{
+		// segments of other format are not reused
+		return false;
+	}
+
+	// requested features are required, existing ones are kept
+	if (m_flags & ~flags || (m_stopGrams > 0 && stopGrams == 0))
+		return false;
+
+	m_flags = flags;
+	m_stopGrams = stopGrams;
+	return true;
+}
+
+void DbWriter::close()
+{
+	m_idxFile.close();
+	m_dataFile.close();
+	m_filesFile.close();
+	m_metaFile.close();
+}
+
+uint32_t DbWriter::writeChunk(const string &fileList,
+		const vector<FileMeta> &filesMeta, const TrigramTable &trigrams)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	uint32_t baseId = writeFilesInfo(fileList, filesMeta);
+
+	RunIndex index;
+	index.offset = m_dataFile.tell();
+
+	// table is iterated in trigrams order, so every chunk is split to sorted
+	// runs, one per partition
+	vector<SortedRun> runs(m_partitions.size());
+	for (SortedRun &run : runs)
+		run.indexesNo = 0;
+
+	size_t indexPos = m_idxFile.tell() / sizeof(RunIndex);
+
+	for (TrigramTable::iterator it = trigrams.begin(); !it.end(); ++it)
+	{
+		size_t size = it.size();
+		if (m_buffer.size() < size)
+			m_buffer.resize(size);
+
+		uint8_t *data = m_buffer.data();
+		it.copyData(data);
+
+		// table keeps varint lists, chunk is stored in database format
+		if (m_flags & INDEX_BLOCK_LISTS)
+		{
+			CompressedIds::toBlocks(data, size, m_blocksBuffer);
+			data = m_blocksBuffer.data();
+			size = m_blocksBuffer.size();
+		}
+
+		// first ID is stored relatively to the chunk, make it absolute
+		uint32_t firstId;
+		size_t oldHeadSize = CompressedIds::decodeDelta(data, size, firstId);
+
+		uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+		size_t headSize = CompressedIds::encodeDelta(baseId + firstId, head);
+
+		index.trigram = it.trigram();
+		index.lastId = baseId + it.lastId();
+		index.firstId = baseId + firstId;
+		index.size = headSize + size - oldHeadSize;
+
+		SortedRun &run = runs[trigramPartition(index.trigram)];
+		if (run.indexesNo == 0)
+		{
+			run.indexOffset = indexPos;
+			run.dataOffset = index.offset;
+			run.dataSize = 0;
+		}
+
+		run.indexesNo++;
+		run.dataSize += index.size;
+		indexPos++;
+
+		m_idxFile.writeObj(index);
+		m_dataFile.write(head, headSize);
+		m_dataFile.write(data + oldHeadSize, size - oldHeadSize);
+
+		index.offset += index.size;
+	}
+
+	m_idxFile.flush();
+	m_dataFile.flush();
+
+	for (unsigned partition = 0; partition < runs.size(); partition++)
+	{
+		if (runs[partition].indexesNo > 0)
+			m_partitions[partition].push_back(runs[partition]);
+	}
+
+	return baseId;
+}
+
+uint32_t DbWriter::addLastChunk(const string &fileList,
+		const vector<FileMeta> &filesMeta, const TrigramTable &trigrams)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	TableRun run;
+	run.trigrams = &trigrams;
+	run.baseId = writeFilesInfo(fileList, filesMeta);
+
+	m_tables.push_back(run);
+	return run.baseId;
+}
+
+uint32_t DbWriter::writeFilesInfo(const string &fileList,
+		const vector<FileMeta> &filesMeta)
+{
+	uint32_t baseId = m_fileId;
+
+	m_filesFile.write(fileList.c_str(), fileList.size()*sizeof(char));
+	m_filesFile.flush();
+
+	m_metaFile.writeVector(filesMeta);
+	m_metaFile.flush();
+
+	m_fileId += filesMeta.size();
+	m_chunksNo++;
+	return baseId;
+}
+
+bool DbWriter::isUpToDate(const string &fname)
+{
+	auto it = m_oldIds.find(fname);
+	if (it == m_oldIds.end())
+		return false;
+
+	uint64_t size;
+	int64_t mtime;
+	if (!getFileInfo(fname, size, mtime))
+		return false;
+
+	// meta could be updated concurrently by the other isUpToDate
+	lock_guard<mutex> lock(m_mutex);
+
+	// file modified during previous indexing could have the same mtime
+	const FileMeta &meta = m_oldMeta[it->second];
+	if (size != meta.size || mtime != meta.mtime || mtime >= m_oldTimestamp)
+		return false;
+
+	keepFile(it->second);
+	return true;
+}
+
+bool DbWriter::isUpToDate(const string &fname, const FileMeta &meta)
+{
+	auto it = m_oldIds.find(fname);
+	if (it == m_oldIds.end())
+		return false;
+
+	lock_guard<mutex> lock(m_mutex);
+
+	FileMeta &oldMeta = m_oldMeta[it->second];
+	if (meta.size != oldMeta.size || meta.hash != oldMeta.hash)
+		return false;
+
+	oldMeta = meta;
+	keepFile(it->second);
+	return true;
+}
+
+void DbWriter::keepFile(uint32_t id)
+{
+	if (!m_keptFiles[id])
+	{
+		m_keptFiles[id] = true;
+		m_keptFilesNo++;
+	}
+}
+
+void DbWriter::sortDatabase(unsigned threadsNo)
+{
+	// new segment of update could refer only to files that are already on
+	// the list, full index renumbers files - its list replaces the old one
+	// together with segments
+	writeFileList();
+
+	if (m_update)
+		replaceFileList();
+
+	Segments segments;
+	segments.read(m_dir);
+
+	// update is stored as a new segment, full index replaces all of them and
+	// is stored as segment 0 unless it is used by the current database
+	uint32_t segment = 0;
+	uint64_t size;
+	int64_t mtime;
+
+	if (m_update || getFileInfo(Segments::indexPath(m_dir, 0), size, mtime))
+		segment = segments.newSegment();
+
+	if (!m_update || m_chunksNo > 0)
+	{
+		// segment is not listed yet, it becomes visible when complete
+		string idxPath = Segments::indexPath(m_dir, segment);
+		string dataPath = Segments::dataPath(m_dir, segment);
+
+		// IDs of updated database precede the new ones
+		uint32_t firstId = m_update ? m_oldFiles.size() : 0;
+
+		::sortDatabase(m_flags, firstId, m_fileId, m_stopGrams,
+				m_partitions, m_tables,
+				m_idxFile.getFileName(), m_dataFile.getFileName(),
+				idxPath + TMP_SUFFIX, dataPath + TMP_SUFFIX, m_sortBufferSize,
+				threadsNo);
+
+		File::rename(idxPath + TMP_SUFFIX, idxPath);
+		File::rename(dataPath + TMP_SUFFIX, dataPath);
+
+		getFileInfo(dataPath, size, mtime);
+		m_chunksSize = size;
+	}
+
+	m_tables.clear();
+	m_idxFile.remove();
+	m_dataFile.remove();
+
+	if (m_update)
+	{
+		if (m_chunksNo > 0)
+		{
+			segments.add(segment);
+			segments.write(m_dir);
+		}
+	}
+	else
+	{
+		Segments newSegments;
+		newSegments.add(segment);
+		newSegments.write(m_dir);
+		replaceFileList();
+
+		for (uint32_t oldSegment : segments)
+		{
+			if (oldSegment != segment)
+			{
+				File::remove(Segments::indexPath(m_dir, oldSegment), true);
+				File::remove(Segments::dataPath(m_dir, oldSegment), true);
+			}
+		}
+
+		// number of files containing trigram is known only when its list is
+		// decoded, so stop-grams are stored by rewriting the segment
+		if (m_stopGrams > 0)
+		{
+			Compactor compactor(m_dir);
+			compactor.compact(true);
+			m_chunksSize = compactor.size();
+		}
+	}
+}
+
+void DbWriter::setMemoryLimit(size_t limit)
+{
+	// indexers keep their last chunks during sort, the buffer takes place of
+	// the read ahead one
+	m_sortBufferSize = min((size_t) SORT_BUFFER_SIZE, limit / 4);
+}
+
+size_t DbWriter::memoryUsage() const
+{
+	return m_oldMemoryUsage;
+}
+
+const Files &DbWriter::getOldFiles() const
+{
+	return m_oldFiles;
+}
+
+void DbWriter::writeFileList()
+{
+	FilesMetaHeader header;
+	header.filesNo = m_fileId;
+	header.reserved = 0;
+	header.timestamp = m_timestamp;
+
+	// files from updated database go first, removed and changed ones are
+	// replaced with tombstones
+	FileTableWriter filesFile(m_dir + PATH_DELIMITER + FILE_LIST_PATH_TMP);
+
+	for (uint32_t id = 0; id < m_oldFiles.size(); id++)
+		filesFile.add(m_keptFiles[id] ? m_oldFiles.get(id) : string());
+
+	// names of indexed files are collected as text lines
+	string chunksFilesPath = m_filesFile.getFileName();
+	m_filesFile.close();
+
+	FileLineReader chunksFiles(chunksFilesPath);
+	const char *name;
+	size_t len;
+
+	while ((name = chunksFiles.readLine(false, &len)) != NULL)
+		filesFile.add(name, len);
+
+	chunksFiles.close();
+	File::remove(chunksFilesPath);
+
+	filesFile.finish();
+	filesFile.close();
+
+	string metaPath = m_dir + PATH_DELIMITER + FILES_META_PATH_TMP;
+
+	if (!m_update)
+	{
+		m_metaFile.seek(0);
+		m_metaFile.writeObj(header);
+		m_metaFile.renameAndClose(metaPath);
+	}
+	else
+	{
+		File metaFile(metaPath, "wb");
+		metaFile.writeObj(header);
+
+		static const FileMeta tombstone = {0, 0, 0};
+
+		for (uint32_t id = 0; id < m_oldFiles.size(); id++)
+			metaFile.writeObj(m_keptFiles[id] ? m_oldMeta[id] : tombstone);
+
+		copyFile(m_metaFile, metaFile, sizeof(FilesMetaHeader));
+		m_metaFile.remove();
+		metaFile.close();
+	}
+}
+
+void DbWriter::replaceFileList()
+{
+	// both files are complete before they replace the old ones, meta goes
+	// first - update rejects list not matching it (see openDatabase)
+	File::rename(m_dir + PATH_DELIMITER + FILES_META_PATH_TMP,
+			m_dir + PATH_DELIMITER + FILES_META_PATH);
+	File::rename(m_dir + PATH_DELIMITER + FILE_LIST_PATH_TMP,
+			m_dir + PATH_DELIMITER + FILE_LIST_PATH);
+}
+
+void DbWriter::copyFile(File &src, File &dst, size_t offset)
+{
+	m_buffer.resize(COPY_BUFFER_SIZE);
+	src.seek(offset);
+
+	while (!src.eof())
+	{
+		size_t len = src.readN(m_buffer.data(), 1, m_buffer.size(), false);
+		dst.write(m_buffer.data(), len);
+	}
+}
+
+size_t DbWriter::filesNo() const
+{
+	return m_fileId;
+}
+
+size_t DbWriter::keptFilesNo() const
+{
+	return m_keptFilesNo;
+}
+
+size_t DbWriter::chunksNo() const
+{
+	return m_chunksNo;
+}
+
+size_t DbWriter::chunksSize() const
+{
+	return m_dataFile.isOpen() ? m_dataFile.size() : m_chunksSize;
+}
@@ -0,0 +1,131 @@
+#ifndef __DB_WRITER_H__
+#define __DB_WRITER_H__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <stdint.h>
+#include "file.h"
+#include "filelist.h"
+#include "filemeta.h"
+#include "compressedids.h"
+#include "trigramtable.h"
+#include "sortdb.h"
+
+
+/* Collects chunks written by (possibly concurrent) indexers and merges them
+ * into the final database. Every chunk covers consecutive range of file IDs,
+ * assigned at the moment the chunk is written.
+ * In update mode chunks are merged into a new database segment, unchanged
+ * files keep their IDs and removed or modified ones are left as tombstones
+ * (empty names on the files list). */
+class DbWriter
+{
+	public:
+		DbWriter();
+
+		/** Returns false if update was requested but existing database could
+		 * not be reused (e.g. has no files metadata) */
+		bool open(const std::string &dir = ".", bool update = false);
+		void close();
+
+		/** Store case-folded trigrams too, must be set before open. Update
+		 * keeps the mode of existing database, it could not be reused if
+		 * folding is requested but the database has none. */
+		void setCaseFolded(bool folded);
+		bool isCaseFolded() const;
+
+		/** Format of lists in the database, the same rules as for case
+		 * folding apply, VARINT is the default one */
+		void setListFormat(CompressedIds::Format format);
+		CompressedIds::Format getListFormat() const;
+
+		/** Store trigrams present in more than percent of files as
+		 * complement lists (see IndexTable), 0 disables it. Lists are
+		 * rewritten by Compactor once the full index is sorted. Update
+		 * keeps the threshold of existing database. */
+		void setStopGrams(unsigned percent);
+		unsigned getStopGrams() const;
+
+		/** Write chunk of trigrams, IDs are local to the chunk (counted from 0).
+		 * Thread safe. Returns ID of first file in chunk */
+		uint32_t writeChunk(const std::string &fileList,
+				const std::vector<FileMeta> &filesMeta,
+				const TrigramTable &trigrams);
+
+		/** Add the last chunk of indexer, its trigrams are merged directly
+		 * from memory by sortDatabase, so they must be kept unchanged until
+		 * then. Thread safe. Returns ID of first file in chunk */
+		uint32_t addLastChunk(const std::string &fileList,
+				const std::vector<FileMeta> &filesMeta,
+				const TrigramTable &trigrams);
+
+		/** Check if file is indexed and not modified since (by its size and
+		 * modification time), such file is kept. Thread safe. */
+		bool isUpToDate(const std::string &fname);
+
+		/** Check if file content is the same as indexed one, such file is
+		 * kept. Thread safe. */
+		bool isUpToDate(const std::string &fname, const FileMeta &meta);
+
+		/** Merge chunks into database segment using threadsNo threads */
+		void sortDatabase(unsigned threadsNo = 1);
+
+		/** Limit memory used by sortDatabase */
+		void setMemoryLimit(size_t limit);
+
+		/** Memory used by files of updated database */
+		size_t memoryUsage() const;
+
+		/** Files of updated database, removed ones have empty names */
+		const Files &getOldFiles() const;
+
+		size_t filesNo() const;
+		size_t keptFilesNo() const;
+		size_t chunksNo() const;
+		size_t chunksSize() const;
+
+	private:
+		bool openDatabase();
+		bool readDatabaseFlags();
+		void keepFile(uint32_t id);
+		uint32_t writeFilesInfo(const std::string &fileList,
+				const std::vector<FileMeta> &filesMeta);
+		void writeFileList();
+		void replaceFileList();
+		void copyFile(File &src, File &dst, size_t offset = 0);
+
+	private:
+		File m_idxFile;
+		File m_dataFile;
+		File m_filesFile;
+		File m_metaFile;
+		std::string m_dir;
+		int64_t m_timestamp;
+		uint32_t m_flags;
+		uint32_t m_stopGrams;
+
+		// database being updated
+		bool m_update;
+		Files m_oldFiles;
+		std::vector<FileMeta> m_oldMeta;
+		std::vector<bool> m_keptFiles;
+		std::unordered_map<std::string, uint32_t> m_oldIds;
+		int64_t m_oldTimestamp;
+		size_t m_keptFilesNo;
+		size_t m_oldMemoryUsage;
+
+		uint32_t m_fileId;
+		std::vector<SortedRuns> m_partitions;
+		TableRuns m_tables;
+		size_t m_chunksNo;
+		size_t m_chunksSize;
+		size_t m_sortBufferSize;
+
+		std::vector<uint8_t> m_buffer;
+		std::vector<uint8_t> m_blocksBuffer;
+		std::mutex m_mutex;
+};
+
+#endif
@@ -0,0 +1,443 @@
+#include "dirwalker.h"
+#include "fileline.h"
+#include "config.h"
+#include "dir.h"
+#include <algorithm>
+#include <cerrno>
+
+extern "C" {
+#include "fnmatch.h"
+}
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <boost/filesystem.hpp>
+#endif
+
+using namespace std;
+
+
+// walkers wait for indexers when that many names is queued
+#define MAX_QUEUED_FILES	0x10000
+
+#define GIT_DIR				".git"
+#define GIT_IGNORE_FNAME	".gitignore"
+
+
+/* Patterns of single .gitignore file. Supported syntax: comments, negation,
+ * directory-only patterns, patterns anchored to the .gitignore directory
+ * and leading or trailing double asterisk. */
+struct DirWalker::IgnoreList
+{
+	struct Pattern
+	{
+		string glob;
+		int flags;
+		bool negate;
+		bool dirOnly;
+		bool anchored;
+	};
+
+	shared_ptr<const IgnoreList> parent;
+	string base;
+	vector<Pattern> patterns;
+
+	void add(string line);
+
+	/** Returns 1 if ignored, 0 if explicitly included, -1 if not matched */
+	int match(const string &path, const string &name, bool dir) const;
+};
+
+
+void DirWalker::IgnoreList::add(string line)
+{
+	while (!line.empty() && (line.back() == ' ' || line.back() == '\r'))
+		line.pop_back();
+
+	if (line.empty() || line[0] == '#')
+		return;
+
+	Pattern pattern;
+	pattern.flags = 0;
+	pattern.negate = line[0] == '!';
+	if (pattern.negate)
+		line.erase(0, 1);
+	else if (line[0] == '\\')
+		line.erase(0, 1);
+
+	pattern.dirOnly = !line.empty() && line.back() == '/';
+	if (pattern.dirOnly)
+		line.pop_back();
+
+	if (line.compare(0, 3, "**/") == 0)
+		line.erase(0, 3);
+
+	// slash anywhere but at the end anchors pattern, "dir/**" too
+	pattern.anchored = line.find('/') != string::npos;
+
+	if (line.size() > 3 && line.compare(line.size() - 3, 3, "/**") == 0)
+	{
+		line.erase(line.size() - 3);
+		pattern.flags |= FNM_LEADING_DIR;
+	}
+
+	if (pattern.anchored)
+	{
+		if (line[0] == '/')
+			line.erase(0, 1);
+
+		if (line.find("**") == string::npos)
+			pattern.flags |= FNM_PATHNAME;
+	}
+
+	if (!line.empty())
+	{
+		pattern.glob = line;
+		patterns.push_back(pattern);
+	}
+}
+
+int DirWalker::IgnoreList::match(const string &path, const string &name,
+		bool dir) const
+{
+	for (auto it = patterns.rbegin(); it != patterns.rend(); ++it)
+	{
+		if (it->dirOnly && !dir)
+			continue;
+
+		const char *str = it->anchored ? path.c_str() + base.size()
+			: name.c_str();
+
+		if (fnmatch(it->glob.c_str(), str, it->flags) == 0)
+			return it->negate ? 0 : 1;
+	}
+
+	return -1;
+}
+
+
+DirWalker::DirWalker() : m_gitIgnore(true), m_busy(0), m_walkers(0),
+	m_stop(false)
+{}
+
+DirWalker::~DirWalker()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_dirsReady.notify_all();
+	m_filesSpace.notify_all();
+
+	for (thread &th : m_threads)
+		th.join();
+}
+
+void DirWalker::addRoot(const string &path)
+{
+	Directory dir;
+	canonizePath(path, dir.path);
+	m_dirs.push_back(dir);
+}
+
+void DirWalker::addExclude(const string &pattern)
+{
+	m_excludes.push_back(pattern);
+}
+
+void DirWalker::useGitIgnore(bool enable)
+{
+	m_gitIgnore = enable;
+}
+
+void DirWalker::start(unsigned threads, const ErrorHandler &errorHandler)
+{
+	m_errorHandler = errorHandler;
+
+	// roots are walked in order they were added
+	reverse(m_dirs.begin(), m_dirs.end());
+
+	// walkers decrement m_walkers on exit, count them up front
+	if (threads == 0)
+		threads = 1;
+
+	m_walkers = threads;
+	for (unsigned i = 0; i < threads; i++)
+		m_threads.emplace_back(&DirWalker::walk, this);
+}
+
+bool DirWalker::next(string &fname)
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	while (m_files.empty() && m_walkers > 0)
+		m_filesReady.wait(lock);
+
+	if (m_files.empty())
+		return false;
+
+	fname.swap(m_files.front());
+	m_files.pop_front();
+
+	m_filesSpace.notify_one();
+	return true;
+}
+
+void DirWalker::walk()
+{
+	vector<Directory> dirs;
+	vector<string> files;
+
+	unique_lock<mutex> lock(m_mutex);
+
+	while (true)
+	{
+		while (m_dirs.empty() && m_busy > 0 && !m_stop)
+			m_dirsReady.wait(lock);
+
+		if (m_dirs.empty() || m_stop)
+			break;
+
+		Directory dir = m_dirs.back();
+		m_dirs.pop_back();
+		m_busy++;
+
+		lock.unlock();
+
+		dirs.clear();
+		files.clear();
+
+		try
+		{
+			walkDirectory(dir, dirs, files);
+		}
+		catch (const Error &ex)
+		{
+			if (m_errorHandler)
+				m_errorHandler(ex);
+		}
+
+		lock.lock();
+
+		// depth first, subdirectories in order
+		m_dirs.insert(m_dirs.end(), dirs.rbegin(), dirs.rend());
+		if (!dirs.empty())
+			m_dirsReady.notify_all();
+
+		for (string &fname : files)
+		{
+			while (m_files.size() >= MAX_QUEUED_FILES && !m_stop)
+			{
+				m_filesReady.notify_all();
+				m_filesSpace.wait(lock);
+			}
+
+			if (m_stop)
+				break;
+
+			m_files.push_back(move(fname));
+		}
+
+		m_filesReady.notify_all();
+
+		if (--m_busy == 0 && m_dirs.empty())
+			m_dirsReady.notify_all();
+	}
+
+	m_walkers--;
+	m_dirsReady.notify_all();
+	m_filesReady.notify_all();
+}
+
+void DirWalker::walkDirectory(const Directory &dir, vector<Directory> &dirs,
+		vector<string> &files)
+{
+	vector<Entry> entries;
+	listDirectory(dir.path.empty() ? "." : dir.path, entries);
+	sort(entries.begin(), entries.end());
+
+	string prefix = dir.path;
+	if (!prefix.empty() && prefix.back() != PATH_DELIMITER)
+		prefix += PATH_DELIMITER;
+
+	shared_ptr<const IgnoreList> ignore = dir.ignore;
+
+	if (m_gitIgnore)
+	{
+		for (const Entry &entry : entries)
+		{
+			if (!entry.dir && entry.name == GIT_IGNORE_FNAME)
+			{
+				ignore = readGitIgnore(prefix + entry.name, prefix, ignore);
+				break;
+			}
+		}
+	}
+
+	for (const Entry &entry : entries)
+	{
+		string path = prefix + entry.name;
+		if (isExcluded(ignore.get(), path, entry))
+			continue;
+
+		if (entry.dir)
+		{
+			Directory subdir;
+			subdir.path = path;
+			subdir.ignore = ignore;
+			dirs.push_back(subdir);
+		}
+		else
+		{
+			files.push_back(path);
+		}
+	}
+}
+
+bool DirWalker::isExcluded(const IgnoreList *ignore, const string &path,
+		const Entry &entry) const
+{
+	if (entry.dir && entry.name == GRIP_DIR)
+		return true;
+
+	if (m_gitIgnore && entry.dir && entry.name == GIT_DIR)
+		return true;
+
+	for (const string &pattern : m_excludes)
+	{
+		if (fnmatch(pattern.c_str(), entry.name.c_str(), 0) == 0)
+			return true;
+	}
+
+	// deeper .gitignore files take precedence
+	for (; ignore; ignore = ignore->parent.get())
+	{
+		int res = ignore->match(path, entry.name, entry.dir);
+		if (res >= 0)
+			return res;
+	}
+
+	return false;
+}
+
+shared_ptr<const DirWalker::IgnoreList> DirWalker::readGitIgnore(
+		const string &fname, const string &base,
+		const shared_ptr<const IgnoreList> &parent)
+{
+	IgnoreList *ignore = new IgnoreList();
+	shared_ptr<const IgnoreList> res(ignore);
+
+	ignore->parent = parent;
+	ignore->base = base;
+
+	FileLineReader file(fname);
+	string line;
+
+	while (file.readLine(line))
+		ignore->add(line);
+
+	return ignore->patterns.empty() ? parent : res;
+}
+
+#if defined(__linux__)
+
+struct LinuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+void DirWalker::listDirectory(const string &path, vector<Entry> &entries)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		throw FuncError("cannot open directory", errno).add("path", path);
+
+	char buffer[32 * 1024] __attribute__((aligned(8)));
+	long size;
+
+	while ((size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (long pos = 0; pos < size;)
+		{
+			const LinuxDirent64 *dirent = (const LinuxDirent64*) (buffer + pos);
+			pos += dirent->d_reclen;
+
+			const char *name = dirent->d_name;
+			if (name[0] == '.' && (name[1] == '\0' ||
+						(name[1] == '.' && name[2] == '\0')))
+				continue;
+
+			unsigned char type = dirent->d_type;
+			if (type == DT_UNKNOWN)
+			{
+				struct stat st;
+				if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+				{
+					if (S_ISDIR(st.st_mode))
+						type = DT_DIR;
+					else if (S_ISREG(st.st_mode))
+						type = DT_REG;
+				}
+			}
+
+			if (type == DT_DIR || type == DT_REG)
+			{
+				Entry entry;
+				entry.name = name;
+				entry.dir = type == DT_DIR;
+				entries.push_back(entry);
+			}
+		}
+	}
+
+	int err = errno;
+	::close(fd);
+
+	if (size < 0)
+		throw FuncError("cannot read directory", err).add("path", path);
+}
+
+#else
+
+void DirWalker::listDirectory(const string &path, vector<Entry> &entries)
+{
+	using namespace boost;
+
+	system::error_code ec;
+	filesystem::directory_iterator it(path, ec), end;
+
+	for (; !ec && it != end; it.increment(ec))
+	{
+		filesystem::file_status status = it->symlink_status(ec);
+		if (ec)
+			break;
+
+		if (filesystem::is_directory(status) ||
+				filesystem::is_regular_file(status))
+		{
+			Entry entry;
+			entry.name = it->path().filename().string();
+			entry.dir = filesystem::is_directory(status);
+			entries.push_back(entry);
+		}
+	}
+
+	if (ec)
+	{
+		throw FuncError("cannot read directory")
+			.add("message", ec.message())
+			.add("path", path);
+	}
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __DIR_WALKER_H__
+#define __DIR_WALKER_H__
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "error.h"
+
+
+/* Walks directory trees in parallel and provides names of regular files
+ * found there. Symbolic links are not followed, database directory is
+ * skipped. Files and directories could be excluded with glob patterns
+ * (matched against their names) and with .gitignore files. */
+class DirWalker
+{
+	public:
+		typedef std::function<void (const Error &err)> ErrorHandler;
+
+	public:
+		DirWalker();
+		~DirWalker();
+
+		void addRoot(const std::string &path);
+		void addExclude(const std::string &pattern);
+		void useGitIgnore(bool enable);
+
+		void start(unsigned threads = 1,
+				const ErrorHandler &errorHandler = ErrorHandler());
+
+		/** Next file name, blocks until one is found. Returns false when
+		 * whole tree was walked. Thread safe. */
+		bool next(std::string &fname);
+
+	private:
+		struct IgnoreList;
+
+		struct Directory
+		{
+			std::string path;
+			std::shared_ptr<const IgnoreList> ignore;
+		};
+
+		struct Entry
+		{
+			std::string name;
+			bool dir;
+
+			bool operator< (const Entry &entry) const
+			{
+				return name < entry.name;
+			}
+		};
+
+	private:
+		DirWalker(const DirWalker &);
+		DirWalker &operator= (const DirWalker &);
+
+		void walk();
+		void walkDirectory(const Directory &dir, std::vector<Directory> &dirs,
+				std::vector<std::string> &files);
+
+		bool isExcluded(const IgnoreList *ignore, const std::string &path,
+				const Entry &entry) const;
+
+		static void listDirectory(const std::string &path,
+				std::vector<Entry> &entries);
+		static std::shared_ptr<const IgnoreList> readGitIgnore(
+				const std::string &fname, const std::string &base,
+				const std::shared_ptr<const IgnoreList> &parent);
+
+	private:
+		std::vector<std::string> m_excludes;
+		bool m_gitIgnore;
+		ErrorHandler m_errorHandler;
+
+		std::vector<Directory> m_dirs;
+		std::deque<std::string> m_files;
+		std::vector<std::thread> m_threads;
+		unsigned m_busy;
+		unsigned m_walkers;
+		bool m_stop;
+
+		std::mutex m_mutex;
+		std::condition_variable m_dirsReady;
+		std::condition_variable m_filesReady;
+		std::condition_variable m_filesSpace;
+};
+
+#endif
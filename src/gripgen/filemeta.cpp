@@ -0,0 +1,68 @@
+#include "filemeta.h"
+#include <cstring>
+
+using namespace std;
+
+
+#define HASH_SEED	0xcbf29ce484222325ULL
+#define HASH_PRIME	0x100000001b3ULL
+#define HASH_MUL	0x9e3779b97f4a7c15ULL
+
+
+ContentHash::ContentHash()
+{
+	reset();
+}
+
+void ContentHash::reset()
+{
+	m_hash = HASH_SEED;
+	m_tail = 0;
+	m_tailSize = 0;
+}
+
+void ContentHash::update(const uint8_t *data, size_t size)
+{
+	// complete word left by previous fragment
+	while (m_tailSize > 0 && size > 0)
+	{
+		m_tail |= (uint64_t) *data++ << (8 * m_tailSize);
+		size--;
+
+		if (++m_tailSize == 8)
+		{
+			mix(m_tail);
+			m_tail = 0;
+			m_tailSize = 0;
+		}
+	}
+
+	for (; size >= 8; data += 8, size -= 8)
+	{
+		uint64_t word;
+		memcpy(&word, data, 8);
+		mix(word);
+	}
+
+	for (size_t i = 0; i < size; i++)
+		m_tail |= (uint64_t) data[i] << (8 * m_tailSize++);
+}
+
+uint64_t ContentHash::get() const
+{
+	uint64_t hash = m_hash ^ m_tail ^ m_tailSize;
+
+	// final avalanche
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+void ContentHash::mix(uint64_t word)
+{
+	m_hash = (m_hash ^ (word * HASH_MUL)) * HASH_PRIME;
+	m_hash ^= m_hash >> 29;
+}
@@ -0,0 +1,47 @@
+#ifndef __FILE_META_H__
+#define __FILE_META_H__
+
+#include <cstddef>
+#include <stdint.h>
+
+
+/* Metadata of indexed file, stored in the same order as the files list.
+ * Used by index update to find files that were not changed. */
+struct FileMeta
+{
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+};
+
+struct FilesMetaHeader
+{
+	uint32_t filesNo;
+	uint32_t reserved;
+
+	// files modified after indexing started could change unnoticed
+	int64_t timestamp;
+};
+
+
+/* Fast non-cryptographic hash of file content, data could be provided in
+ * fragments of any size. */
+class ContentHash
+{
+	public:
+		ContentHash();
+
+		void reset();
+		void update(const uint8_t *data, size_t size);
+		uint64_t get() const;
+
+	private:
+		void mix(uint64_t word);
+
+	private:
+		uint64_t m_hash;
+		uint64_t m_tail;
+		unsigned m_tailSize;
+};
+
+#endif
@@ -1,10 +1,21 @@
 #include "indexer.h"
+#include "readahead.h"
+#include "dirwalker.h"
+#include "dbwriter.h"
+#include "compactor.h"
+#include "segments.h"
 #include "dir.h"
 #include "fileline.h"
 #include "config.h"
 #include "print.h"
 #include "error.h"
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <vector>
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
@@ -20,13 +31,44 @@ using namespace std::chrono;
 enum
 {
 	CHUNK_SIZE_OPTION = CHAR_MAX + 1,
+	MEMORY_LIMIT_OPTION,
+	READ_AHEAD_OPTION,
+	READ_AHEAD_SIZE_OPTION,
+	READ_THREADS_OPTION,
+	COMPACT_OPTION,
+	EXCLUDE_OPTION,
+	NO_IGNORE_OPTION,
+	FOLD_CASE_OPTION,
+	LIST_FORMAT_OPTION,
+	STOP_GRAMS_OPTION,
 };
 
+// update compacts database when it has more segments
+#define AUTO_COMPACT_SEGMENTS	8
+
+// trigrams present in more files (in percents) are stop-grams by default
+#define DEFAULT_STOP_GRAMS		90
+
+// indexer memory left for chunk besides its buffers, less makes chunks of
+// just a few files
+#define MIN_CHUNK_MEMORY		(4*1024*1024)
+
 
 static struct option const LONGOPTS[] =
 {
 	{"update", no_argument, NULL, 'u'},
+	{"compact", optional_argument, NULL, COMPACT_OPTION},
 	{"chunk-size", required_argument, NULL, CHUNK_SIZE_OPTION},
+	{"memory-limit", required_argument, NULL, MEMORY_LIMIT_OPTION},
+	{"jobs", required_argument, NULL, 'j'},
+	{"exclude", required_argument, NULL, EXCLUDE_OPTION},
+	{"no-ignore", no_argument, NULL, NO_IGNORE_OPTION},
+	{"fold-case", no_argument, NULL, FOLD_CASE_OPTION},
+	{"list-format", required_argument, NULL, LIST_FORMAT_OPTION},
+	{"stop-grams", optional_argument, NULL, STOP_GRAMS_OPTION},
+	{"read-ahead", required_argument, NULL, READ_AHEAD_OPTION},
+	{"read-ahead-size", required_argument, NULL, READ_AHEAD_SIZE_OPTION},
+	{"read-threads", required_argument, NULL, READ_THREADS_OPTION},
 	{"verbose", optional_argument, NULL, 'v'},
 	{"quiet", no_argument, NULL, 'q'},
 	{"silent", no_argument, NULL, 'q'},
@@ -36,10 +78,26 @@ static struct option const LONGOPTS[] =
 	{NULL, 0, NULL, 0}
 };
 
-static char const SHORTOPTS[] = "hqsuvV";
-
-
-static void printProgress(const Indexer &indexer, unsigned long chunksNo, const string &fileName);
+static char const SHORTOPTS[] = "hj:qsuvV";
+
+
+// provides names of files to index, returns false at the end
+typedef function<bool (string &fileName)> FileNames;
+
+static bool readFileList(FileLineReader &files, string &fileName);
+static bool readOldFileList(const Files &files, uint32_t &id,
+		string &fileName);
+static bool isDatabaseFile(const char *fname);
+static bool nextFile(const FileNames &names, DbWriter &db, string &fileName,
+		int verbose);
+static void indexFiles(Indexer &indexer, const FileNames &names,
+		DbWriter &db, size_t chunkSize, int verbose);
+static void indexQueue(Indexer &indexer, ReadAhead &queue, size_t chunkSize,
+		int verbose);
+static void flushChunk(Indexer &indexer, size_t chunkSize, int verbose);
+static void runJobs(unsigned jobs, const function<void (unsigned no)> &job);
+static void compactDatabase(bool all, int verbose);
+static void printProgress(unsigned long filesNo, const string &fileName);
 static void printFileError(const Error &err, const char *fname);
 static void printGenericError(const Error &er);
 static void usage(const char *name);
@@ -51,16 +109,36 @@ static steady_clock::time_point startTime, lastTime;
 static bool supressErrors = false;
 static int result;
 
+// guards file list reading, progress counters and printing
+static mutex filesMutex;
+static unsigned long filesNo;
+
+// indexing job failed, the other ones stop too
+static atomic<bool> jobsFailed(false);
+
 
 int main(int argc, char * const argv[])
 {
-	Indexer indexer;
+	DbWriter db;
 	size_t chunkSize = 64 * 1024 * 1024;
+	size_t memoryLimit = 0;
+	unsigned jobs = 1;
+	size_t readAhead = 64;
+	size_t readAheadSize = 64 * 1024 * 1024;
+	unsigned readThreads = 1;
 
 	FileLineReader files;
+	DirWalker walker;
+	FileNames names;
+
+	// files of updated index are indexed again if no list is given
+	bool oldFileList = false;
+	uint32_t oldFileId = 0;
 
 	int verbose = 1;
 	bool updateIndex = false;
+	bool compactIndex = false;
+	bool compactAll = false;
 
 	result = 0;
 
@@ -79,6 +157,59 @@ int main(int argc, char * const argv[])
 					updateIndex = true;
 					break;
 
+				case COMPACT_OPTION:
+					compactIndex = true;
+					if (optarg != NULL)
+					{
+						if (strcmp(optarg, "all") != 0)
+						{
+							throw FuncError("invalid compaction mode")
+								.add("mode", optarg);
+						}
+
+						compactAll = true;
+					}
+					break;
+
+				case EXCLUDE_OPTION:
+					walker.addExclude(optarg);
+					break;
+
+				case NO_IGNORE_OPTION:
+					walker.useGitIgnore(false);
+					break;
+
+				case FOLD_CASE_OPTION:
+					db.setCaseFolded(true);
+					break;
+
+				case LIST_FORMAT_OPTION:
+					if (strcmp(optarg, "varint") == 0)
+						db.setListFormat(CompressedIds::VARINT);
+					else if (strcmp(optarg, "blocks") == 0)
+						db.setListFormat(CompressedIds::BLOCKS);
+					else
+						throw FuncError("invalid lists format")
+							.add("format", optarg);
+					break;
+
+				case STOP_GRAMS_OPTION:
+				{
+					int percent = optarg ? atoi(optarg) : DEFAULT_STOP_GRAMS;
+					if (percent < 50 || percent > 99)
+					{
+						throw FuncError("invalid stop-grams threshold")
+							.add("percent", optarg);
+					}
+
+					db.setStopGrams(percent);
+					break;
+				}
+
+				case 'j':
+					jobs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+					break;
+
 				case 'v':
 					if (optarg != NULL)
 						verbose = atoi(optarg);
@@ -95,6 +226,22 @@ int main(int argc, char * const argv[])
 					chunkSize = atol(optarg) * 1024 * 1024;
 					break;
 
+				case MEMORY_LIMIT_OPTION:
+					memoryLimit = atol(optarg) * 1024 * 1024;
+					break;
+
+				case READ_AHEAD_OPTION:
+					readAhead = atol(optarg);
+					break;
+
+				case READ_AHEAD_SIZE_OPTION:
+					readAheadSize = atol(optarg) * 1024 * 1024;
+					break;
+
+				case READ_THREADS_OPTION:
+					readThreads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+					break;
+
 				case 'V':
 					version(argv[0]);
 					return 0;
@@ -107,7 +254,28 @@ int main(int argc, char * const argv[])
 			}
 		}
 
-		if (optind < argc)
+		if (compactIndex && !updateIndex)
+		{
+			compactDatabase(compactAll, verbose);
+			return result;
+		}
+
+		if (optind < argc && directoryExists(argv[optind]))
+		{
+			for (int i = optind; i < argc; i++)
+			{
+				if (!directoryExists(argv[i]))
+				{
+					throw FuncError("expected directory to index")
+						.add("path", argv[i]);
+				}
+
+				if (verbose >= 2)
+					println("indexing directory %s", argv[i]);
+				walker.addRoot(argv[i]);
+			}
+		}
+		else if (optind < argc)
 		{
 			if (verbose >= 2)
 				println("reading list from file %s", argv[optind]);
@@ -117,7 +285,7 @@ int main(int argc, char * const argv[])
 		{
 			if (verbose >= 2)
 				println("updating existing index (\"" FILE_LIST_PATH "\")");
-			files.open(FILE_LIST_PATH);
+			oldFileList = true;
 		}
 		else
 		{
@@ -126,91 +294,185 @@ int main(int argc, char * const argv[])
 			files.open(stdin);
 		}
 
-		if (verbose >= 2)
+		if (!db.open(".", updateIndex))
 		{
-			println("max chunk size: %zu MB",
-					chunkSize / (1024*1024));
+			if (oldFileList)
+				throw FuncError("existing index could not be updated, "
+						"list of files to index is required");
+
+			if (verbose >= 1)
+				println("existing index could not be updated, rebuilding it");
 		}
 
-		if (verbose >= 1)
-			print("indexing...");
+		size_t indexerMemoryLimit = 0;
+		if (memoryLimit > 0)
+		{
+			// read ahead buffer and files of updated index are taken from
+			// the limit first, the rest is shared by indexers
+			if (readAhead > 0 && readAheadSize > memoryLimit / 4)
+				readAheadSize = memoryLimit / 4;
 
-		indexer.open();
+			size_t reserved = db.memoryUsage();
+			if (readAhead > 0)
+				reserved += readAheadSize;
 
-		startTime = lastTime = steady_clock::now();
+			// indexers need their buffers and room for chunks, fewer of them
+			// are run if the limit is too low
+			size_t indexerMemory = MIN_CHUNK_MEMORY +
+				Indexer::fixedMemoryUsage(db.isCaseFolded());
 
-		unsigned long chunksNo = 0;
-		unsigned long filesNo = 0;
-		string fileName;
-		const char *fname;
+			unsigned maxJobs = jobs;
+			while (jobs > 1 && reserved + jobs * indexerMemory > memoryLimit)
+				jobs--;
 
-		try
-		{
-			while ((fname = files.readLine(false)) != NULL)
+			if (reserved + indexerMemory > memoryLimit)
 			{
-				try
-				{
-					if (strncmp(fname, GRIP_DIR, sizeof(GRIP_DIR) - 1) == 0)
-						continue;
+				throw FuncError("memory limit too low")
+					.add("limit", humanReadableSize(memoryLimit))
+					.add("required", humanReadableSize(reserved +
+								indexerMemory));
+			}
 
-					if (strstr(fname, PATH_DELIMITER_S GRIP_DIR PATH_DELIMITER_S))
-						continue;
+			if (jobs < maxJobs && verbose >= 1)
+				println("memory limit allows only %u indexing jobs", jobs);
 
-					filesNo++;
-					canonizePath(fname, fileName);
-					if (verbose >= 1)
-						printProgress(indexer, filesNo, fileName);
+			indexerMemoryLimit = (memoryLimit - reserved) / jobs;
+			db.setMemoryLimit(memoryLimit);
+		}
 
-					indexer.indexFile(fileName);
+		if (verbose >= 2)
+		{
+			println("max chunk size: %zu MB",
+					chunkSize / (1024*1024));
+			if (memoryLimit > 0)
+			{
+				println("memory limit: %zu MB, %zu MB per indexer",
+						memoryLimit / (1024*1024),
+						indexerMemoryLimit / (1024*1024));
+			}
+			println("indexing jobs: %u", jobs);
+			if (readAhead > 0)
+			{
+				println("read ahead: %zu files, %zu MB, %u %s",
+						readAhead, readAheadSize / (1024*1024), readThreads,
+						readThreads == 1 ? "thread" : "threads");
+			}
+			else
+			{
+				println("read ahead: disabled");
+			}
+		}
 
-					if (indexer.size() >= chunkSize)
-					{
-						if (verbose >= 1)
-						{
-							reprint("writing chunks to database...");
-							lastTime = steady_clock::now();
-						}
+		if (verbose >= 1)
+			print("indexing...");
 
-						indexer.write();
-						chunksNo++;
-					}
-				}
-				catch (const Error &ex)
-				{
-					printFileError(ex, fname);
-				}
-			}
+		startTime = lastTime = steady_clock::now();
+		filesNo = 0;
+
+		if (files.isOpen())
+		{
+			names = [&files](string &fileName) {
+					return readFileList(files, fileName);
+				};
 		}
-		catch (const Error &ex)
+		else if (oldFileList)
 		{
-			printGenericError(ex);
-			result = 2;
+			names = [&db, &oldFileId](string &fileName) {
+					return readOldFileList(db.getOldFiles(), oldFileId,
+							fileName);
+				};
+		}
+		else
+		{
+			// directories are walked by as many threads as files are indexed
+			walker.start(jobs, [](const Error &err) {
+					lock_guard<mutex> lock(filesMutex);
+					printFileError(err, err.get("path").c_str());
+				});
+
+			names = [&walker](string &fileName) {
+					return walker.next(fileName);
+				};
+		}
+
+		// every indexer keeps its own trigram table, so the chunk size limit
+		// is shared between them
+		vector<unique_ptr<Indexer>> indexers;
+		for (unsigned i = 0; i < jobs; i++)
+		{
+			indexers.emplace_back(new Indexer(db));
+			indexers.back()->setMemoryLimit(indexerMemoryLimit);
 		}
 
+		if (readAhead > 0)
+		{
+			ReadAhead queue(readAhead, readAheadSize);
+			queue.start([&names, &db, verbose](string &fileName) {
+					return nextFile(names, db, fileName, verbose);
+				}, readThreads);
+
+			runJobs(jobs, [&](unsigned no) {
+					indexQueue(*indexers[no], queue, chunkSize / jobs, verbose);
+				});
+		}
+		else
+		{
+			runJobs(jobs, [&](unsigned no) {
+					indexFiles(*indexers[no], names, db, chunkSize / jobs,
+							verbose);
+				});
+		}
 
 		if (verbose >= 1)
 		{
 			reprint("sorting chunks database...");
 		}
 
-		files.close();
-		indexer.sortDatabase();
-		chunksNo++;
+		if (files.isOpen())
+			files.close();
+
+		size_t indexedNo = 0;
+		size_t totalSize = 0;
+		for (auto &indexer : indexers)
+		{
+			indexer->finish();
+			indexedNo += indexer->filesNo();
+			totalSize += indexer->filesTotalSize();
+		}
+
+		size_t chunksNo = db.chunksNo();
+		db.sortDatabase(jobs);
+		indexers.clear();
 
 		if (verbose >= 1)
 		{
+
 			auto now = steady_clock::now();
 			float duration = duration_cast<milliseconds>(now - startTime).count();
-			float bytesSec = (float)indexer.filesTotalSize() * 1000.f / duration;
-			float filesSec = (float)indexer.filesNo() * 1000.f / duration;
+			float bytesSec = (float)totalSize * 1000.f / duration;
+			float filesSec = (float)indexedNo * 1000.f / duration;
 
 			reprint("done");
 
-			println(" - files:    indexed %zu (%s), skipped %zu, total %zu",
-					indexer.filesNo(),
-					humanReadableSize(indexer.filesTotalSize()).c_str(),
-					(filesNo - indexer.filesNo()),
-					filesNo);
+			size_t keptNo = db.keptFilesNo();
+			if (updateIndex)
+			{
+				println(" - files:    indexed %zu (%s), unchanged %zu, "
+						"skipped %zu, total %zu",
+						indexedNo,
+						humanReadableSize(totalSize).c_str(),
+						keptNo,
+						(filesNo - indexedNo - keptNo),
+						filesNo);
+			}
+			else
+			{
+				println(" - files:    indexed %zu (%s), skipped %zu, total %zu",
+						indexedNo,
+						humanReadableSize(totalSize).c_str(),
+						(filesNo - indexedNo),
+						filesNo);
+			}
 
 			println(" - speed:    %.1f files/sec, %s/sec",
 					filesSec,
@@ -219,10 +481,19 @@ int main(int argc, char * const argv[])
 			println(" - time:     %.3f sec",
 					duration / 1000.f);
 
-			println(" - database: %s in %lu %s",
-					humanReadableSize(indexer.chunksSize()).c_str(),
+			println(" - database: %s in %zu %s",
+					humanReadableSize(db.chunksSize()).c_str(),
 					chunksNo,
-					chunksNo == 1 ? "chunk" : "chunks (merged to 1)");
+					chunksNo <= 1 ? "chunk" : "chunks (merged to 1)");
+		}
+
+		if (updateIndex)
+		{
+			Segments segments;
+			segments.read(".");
+
+			if (compactIndex || segments.size() > AUTO_COMPACT_SEGMENTS)
+				compactDatabase(compactAll, verbose);
 		}
 	}
 	catch (const Error &ex)
@@ -239,17 +510,244 @@ int main(int argc, char * const argv[])
 	return result;
 }
 
-void printProgress(const Indexer &indexer, unsigned long chunksNo, const string &fileName)
+bool readFileList(FileLineReader &files, string &fileName)
+{
+	lock_guard<mutex> lock(filesMutex);
+
+	while (true)
+	{
+		const char *fname;
+
+		try
+		{
+			fname = files.readLine(false);
+		}
+		catch (const Error &ex)
+		{
+			printGenericError(ex);
+			result = 2;
+			fname = NULL;
+		}
+
+		if (fname == NULL)
+			return false;
+
+		if (*fname == '\0' || isDatabaseFile(fname))
+			continue;
+
+		canonizePath(fname, fileName);
+		return true;
+	}
+}
+
+bool readOldFileList(const Files &files, uint32_t &id, string &fileName)
+{
+	lock_guard<mutex> lock(filesMutex);
+
+	while (id < files.size())
+	{
+		const string &fname = files.get(id++);
+
+		// tombstone of removed file
+		if (fname.empty() || isDatabaseFile(fname.c_str()))
+			continue;
+
+		canonizePath(fname, fileName);
+		return true;
+	}
+
+	return false;
+}
+
+bool isDatabaseFile(const char *fname)
+{
+	return strncmp(fname, GRIP_DIR, sizeof(GRIP_DIR) - 1) == 0 ||
+		strstr(fname, PATH_DELIMITER_S GRIP_DIR PATH_DELIMITER_S);
+}
+
+bool nextFile(const FileNames &names, DbWriter &db, string &fileName,
+		int verbose)
+{
+	while (names(fileName))
+	{
+		{
+			lock_guard<mutex> lock(filesMutex);
+			filesNo++;
+			if (verbose >= 1)
+				printProgress(filesNo, fileName);
+		}
+
+		if (!db.isUpToDate(fileName))
+			return true;
+	}
+
+	return false;
+}
+
+void indexFiles(Indexer &indexer, const FileNames &names, DbWriter &db,
+		size_t chunkSize, int verbose)
+{
+	string fileName;
+
+	while (!jobsFailed && nextFile(names, db, fileName, verbose))
+	{
+		try
+		{
+			indexer.indexFile(fileName);
+			flushChunk(indexer, chunkSize, verbose);
+		}
+		catch (const Error &ex)
+		{
+			lock_guard<mutex> lock(filesMutex);
+			printFileError(ex, fileName.c_str());
+		}
+	}
+}
+
+void indexQueue(Indexer &indexer, ReadAhead &queue, size_t chunkSize,
+		int verbose)
+{
+	while (unique_ptr<ReadAhead::Entry> entry = queue.pop())
+	{
+		if (jobsFailed)
+			break;
+
+		const string &fileName = entry->fileName();
+
+		try
+		{
+			if (entry->error())
+				throw *entry->error();
+
+			if (entry->loaded())
+				indexer.indexData(fileName, entry->data(), entry->size(),
+						entry->mtime());
+			else
+				indexer.indexFile(fileName);
+
+			flushChunk(indexer, chunkSize, verbose);
+		}
+		catch (const Error &ex)
+		{
+			lock_guard<mutex> lock(filesMutex);
+			printFileError(ex, fileName.c_str());
+		}
+	}
+}
+
+/* Runs job in up to jobs threads, each one gets its number. Errors of
+ * single files are handled by job, any other exception stops all threads and
+ * the first one is rethrown when they are joined. */
+void runJobs(unsigned jobs, const function<void (unsigned no)> &job)
+{
+	unique_ptr<Error> error;
+
+	auto setError = [&error](const Error &ex) {
+			lock_guard<mutex> lock(filesMutex);
+			if (!error)
+				error.reset(new Error(ex));
+			jobsFailed = true;
+		};
+
+	auto worker = [&](unsigned no) {
+			try
+			{
+				job(no);
+			}
+			catch (const Error &ex)
+			{
+				setError(ex);
+			}
+			catch (const exception &ex)
+			{
+				setError(FuncError(ex.what()));
+			}
+		};
+
+	vector<thread> threads;
+
+	try
+	{
+		for (unsigned i = 1; i < jobs; i++)
+			threads.emplace_back(worker, i);
+	}
+	catch (const exception &)
+	{
+		// files are shared dynamically, started threads index them all
+	}
+
+	worker(0);
+
+	for (thread &th : threads)
+		th.join();
+
+	if (error)
+		throw *error;
+}
+
+void flushChunk(Indexer &indexer, size_t chunkSize, int verbose)
+{
+	bool overMemoryLimit = indexer.overMemoryLimit();
+
+	if (indexer.size() >= chunkSize || overMemoryLimit)
+	{
+		if (verbose >= 1)
+		{
+			lock_guard<mutex> lock(filesMutex);
+			reprint("writing chunks to database...");
+			lastTime = steady_clock::now();
+		}
+
+		// memory reserved by chunk that exceeded the limit (e.g. by single
+		// huge file) is not kept for the next ones
+		if (overMemoryLimit)
+			indexer.releaseMemory();
+		else
+			indexer.write();
+	}
+}
+
+void compactDatabase(bool all, int verbose)
+{
+	if (verbose >= 1)
+		print("compacting database...");
+
+	Compactor compactor;
+	size_t segmentsNo = compactor.segmentsNo();
+	size_t sizeBefore = compactor.size();
+
+	// merged segment could form next tier with older ones
+	size_t merged;
+	do
+	{
+		merged = compactor.compact(all);
+	}
+	while (merged > 0 && !all);
+
+	if (verbose >= 1)
+	{
+		reprint("done");
+		println(" - segments: %zu, was %zu",
+				compactor.segmentsNo(),
+				segmentsNo);
+
+		println(" - database: %s, was %s",
+				humanReadableSize(compactor.size()).c_str(),
+				humanReadableSize(sizeBefore).c_str());
+	}
+}
+
+void printProgress(unsigned long filesNo, const string &fileName)
 {
 	auto now = steady_clock::now();
 
 	if (duration_cast<milliseconds>(now - lastTime) > milliseconds(1000))
 	{
 		float duration = duration_cast<milliseconds>(now - startTime).count();
-		float speed = (float) indexer.filesNo() * 1000.f / duration;
+		float speed = (float) filesNo * 1000.f / duration;
 
 		reprint("indexing file %lu+ (%.0f files/sec): %s",
-				chunksNo, speed, fileName.c_str());
+				filesNo, speed, fileName.c_str());
 
 		lastTime = now;
 	}
@@ -273,12 +771,29 @@ void printGenericError(const Error &err)
 
 void usage(const char *name)
 {
-	printf("Usage: %s [OPTIONS] [LIST]\n"
+	printf("Usage: %s [OPTIONS] [LIST | DIR...]\n"
 	"Generate index for grip\n"
 	"\n"
 	"Options:\n"
-	"  -u, --update              update existing index (reindex file)\n"
+	"  -u, --update              update existing index, only new and modified\n"
+	"                            files are indexed\n"
+	"      --compact[=all]       merge index segments of similar size (or all)\n"
 	"      --chunk-size=SIZE     set chunks size (in MB)\n"
+	"      --memory-limit=SIZE   write chunks to keep memory usage below SIZE\n"
+	"                            (in MB)\n"
+	"  -j, --jobs=N              index files using N threads\n"
+	"      --exclude=GLOB        skip files and directories matching GLOB\n"
+	"      --no-ignore           don't use .gitignore files\n"
+	"      --fold-case           index case-folded trigrams too, speeds up\n"
+	"                            case insensitive queries\n"
+	"      --list-format=FORMAT  store IDs lists as varint (default, smaller) or\n"
+	"                            blocks (faster to decode)\n"
+	"      --stop-grams[=PERCENT]  store trigrams present in more than PERCENT\n"
+	"                            (default 90) of files as lists of files without\n"
+	"                            them, queries use them last\n"
+	"      --read-ahead=N        open up to N files ahead of indexing (0 disables)\n"
+	"      --read-ahead-size=SIZE  limit read ahead data (in MB)\n"
+	"      --read-threads=N      open files using N threads\n"
 	"  -v, --verbose[=LEVEL]     be verbose (repeat to increase)\n"
 	"  -q, --quiet, --silent     be quiet\n"
 	"  -s, --no-messages         suppress error messages\n"
@@ -286,7 +801,13 @@ void usage(const char *name)
 	"\n"
 	"LIST is file containing list of files to index, one per line.\n"
 	"With no LIST, standard input will be read instead\n"
-	"Example: find -type f -and -size -128k | gripgen\n",
+	"Files inside DIRs are indexed recursively, skipping ones ignored by git\n"
+	"Updates are stored as separate segments, --compact without --update only\n"
+	"merges segments of existing index\n"
+	"Update keeps --fold-case, --list-format=blocks and --stop-grams of existing\n"
+	"index, index without them is rebuilt when they are requested\n"
+	"Example: find -type f -and -size -128k | gripgen\n"
+	"         gripgen --exclude='*.o' .\n",
 	name);
 }
 
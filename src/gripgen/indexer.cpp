@@ -1,8 +1,9 @@
 #include "indexer.h"
 #include "index.h"
+#include "mappedfile.h"
 #include "dir.h"
-#include "config.h"
 #include "error.h"
+#include <algorithm>
 #include <cstring>
 
 using namespace std;
@@ -12,48 +13,72 @@ static const size_t initBufferSize = 32 * 1024;
 
 #define TRIGRAMS_NO 0x1000000
 
+// approximated memory needed to add trigram to the table
+#define TRIGRAM_MEMORY	64
 
-void sortDatabase(File &oldIdxFile, File &oldDataFile, File &newIdxFile,
-		File &newDataFile);
 
-
-Indexer::Indexer(size_t bufferSize)
-	: m_size(0), m_filesTotalSize(0), m_chunksSize(0), m_fileId(0)
+Indexer::Indexer(DbWriter &db, size_t bufferSize)
+	: m_db(db), m_size(0), m_memoryLimit(0), m_filesNo(0), m_filesTotalSize(0),
+	m_fileId(0), m_caseFolded(db.isCaseFolded())
 {
 	if (bufferSize < initBufferSize)
 		bufferSize = initBufferSize;
 
 	m_buffer.resize(bufferSize);
-	m_ids = new CompressedIds*[TRIGRAMS_NO];
-	memset(m_ids, 0, TRIGRAMS_NO*sizeof(CompressedIds*));
+	m_trigramsBuffer.resize(initBufferSize);
+	m_fileTrigramsSet.resize((m_caseFolded ? 2 : 1) * TRIGRAMS_NO / 64);
 }
 
-void Indexer::open(const string &dir)
-{
-	m_dir = dir;
-	makeDirectory(dir + PATH_DELIMITER + GRIP_DIR);
-	m_idxFile.open(dir + PATH_DELIMITER + TRIGRAMS_LIST_PATH_TMP, "w+b");
-	m_dataFile.open(dir + PATH_DELIMITER + TRIGRAMS_DATA_PATH_TMP, "w+b");
-	m_filesFile.open(dir + PATH_DELIMITER + FILE_LIST_PATH_TMP, "wb");
-}
+Indexer::~Indexer()
+{}
 
-void Indexer::close()
+bool Indexer::indexFile(const string &fname)
 {
-	m_idxFile.close();
-	m_dataFile.close();
-	m_filesFile.close();
+	// file info is taken before reading, so concurrent modification will be
+	// detected by the next update
+	uint64_t size;
+	int64_t mtime = 0;
+	getFileInfo(fname, size, mtime);
+
+	MappedFile mapped;
+	if (mapped.open(fname, MappedFile::SEQUENTIAL))
+		return indexData(fname, mapped.data(), mapped.size(), mtime);
+	else
+		return indexStream(fname, mtime);
 }
 
-Indexer::~Indexer()
+bool Indexer::indexData(const string &fname, const uint8_t *data,
+		size_t fileSize, int64_t mtime)
 {
-	if (m_size > 0)
-		write();
+	if (fileSize < 3)
+		return false;
+
+	startFile();
 
-	freeIds();
-	delete [] m_ids;
+	// first check only small fragment of file, pages behind it are not
+	// touched when file turns out to be binary
+	size_t size = min(fileSize, initBufferSize);
+	bool text = false;
+
+	// mapped file could be truncated meanwhile, then it is skipped
+	if (!MappedFile::guard([&]() {
+				text = scanTrigrams(data, size) &&
+					scanTrigrams(data + size, fileSize - size);
+			}))
+	{
+		throw ThisError("cannot read file")
+			.add("msg", "file truncated while indexing")
+			.add("file", fname);
+	}
+
+	if (!text)
+		return false;
+
+	finishFile(fname, fileSize, mtime);
+	return true;
 }
 
-bool Indexer::indexFile(const string &fname)
+bool Indexer::indexStream(const string &fname, int64_t mtime)
 {
 	File file(fname, "rb");
 	size_t fileSize = file.size();
@@ -63,137 +88,192 @@ bool Indexer::indexFile(const string &fname)
 
 	uint8_t *data = m_buffer.data();
 
+	startFile();
+
 	// first check only small fragment of file
 	size_t size = file.readN(data, 1, initBufferSize, false);
-	if (memchr(data, 0, size))
+	if (!scanTrigrams(data, size))
 		return false;
 
-	// fill the buffer and check the remaining fragment
-	if (!file.eof())
+	while (!file.eof())
 	{
-		size_t read = file.readN(data+size, 1, m_buffer.size()-size, false);
-		if (memchr(data+size, 0, read))
+		size = file.readN(data, 1, m_buffer.size(), false);
+		if (!scanTrigrams(data, size))
 			return false;
-
-		size += read;
 	}
 
-	uint32_t fileId = addFile(fname);
-	uint32_t trigram = '\n';
+	finishFile(fname, fileSize, mtime);
+	return true;
+}
+
+void Indexer::startFile()
+{
+	// drop leftovers of file that failed to index
+	clearFileTrigrams();
+	m_scanner.reset();
+	m_hash.reset();
+}
 
-	while (size > 0)
+void Indexer::finishFile(const string &fname, size_t fileSize,
+		int64_t mtime)
+{
+	FileMeta meta;
+	meta.size = fileSize;
+	meta.mtime = mtime;
+	meta.hash = m_hash.get();
+
+	// only modification time was changed
+	if (m_db.isUpToDate(fname, meta))
 	{
-		for (size_t i = 0; i < size; i++)
-		{
-			// ignoring windows newline encoding
-			if (data[i] == '\r')
-				continue;
+		clearFileTrigrams();
+		return;
+	}
 
-			trigram <<= 8;
-			trigram |= data[i];
+	uint32_t trigram;
+	if (m_scanner.finish(trigram))
+		addTrigram(trigram);
 
-			if (trigram & 0xff0000)
-				addTrigram(trigram, fileId);
+	if (m_memoryLimit > 0 && m_fileId > 0 && memoryUsage()
+			+ m_fileTrigrams.size() * TRIGRAM_MEMORY > m_memoryLimit)
+	{
+		write();
+	}
 
-			// don't keep trigrams with newline symbol in the middle as we are
-			// grepping whole lines only
-			if (data[i] == '\n')
-				trigram = '\n';
-		}
+	uint32_t fileId = addFile(fname, meta);
+	commitFileTrigrams(fileId);
 
-		if (file.eof())
-			break;
+	m_filesNo++;
+	m_filesTotalSize += fileSize;
+}
 
-		size = file.readN(data, 1, m_buffer.size());
-	}
+bool Indexer::scanTrigrams(const uint8_t *data, size_t size)
+{
+	uint32_t *trigrams = m_trigramsBuffer.data();
 
-	if (trigram & 0xff00)
+	for (size_t pos = 0; pos < size; pos += initBufferSize)
 	{
-		// add newline at the end of file to ensure '$' works properly
-		trigram <<= 8;
-		trigram |= '\n';
-		addTrigram(trigram, fileId);
+		size_t len = min(size - pos, initBufferSize);
+		if (!m_scanner.scan(data + pos, len, trigrams))
+			return false;
+
+		m_hash.update(data + pos, len);
+
+		for (size_t i = 0; i < len; i++)
+			addTrigram(trigrams[i]);
 	}
 
-	m_filesTotalSize += fileSize;
 	return true;
 }
 
-uint32_t Indexer::addFile(const std::string &fname)
+uint32_t Indexer::addFile(const std::string &fname, const FileMeta &meta)
 {
 	m_fileList += fname + '\n';
+	m_filesMeta.push_back(meta);
 	return m_fileId++;
 }
 
-void Indexer::addTrigram(uint32_t trigram, uint32_t fileId)
+void Indexer::addTrigram(uint32_t trigram)
 {
-	CompressedIds **ids = m_ids + (trigram & 0x00ffffff);
-	if (*ids == NULL)
-		*ids = new CompressedIds();
+	trigram &= 0x00ffffff;
+
+	uint64_t &word = m_fileTrigramsSet[trigram / 64];
+	uint64_t bit = (uint64_t) 1 << (trigram % 64);
 
-	m_size += (*ids)->add(fileId);
+	if (!(word & bit))
+	{
+		word |= bit;
+		m_fileTrigrams.push_back(trigram);
+	}
 }
 
-void Indexer::freeIds()
+// folded trigrams are derived from distinct ones, not from every occurrence
+void Indexer::addFoldedTrigrams()
 {
-	for (uint32_t trigram = 0; trigram < TRIGRAMS_NO; trigram++)
+	size_t trigramsNo = m_fileTrigrams.size();
+
+	for (size_t i = 0; i < trigramsNo; i++)
 	{
-		if (m_ids[trigram] != NULL)
+		uint32_t folded = foldTrigram(m_fileTrigrams[i]);
+		if (folded == m_fileTrigrams[i])
+			continue;
+
+		uint64_t &word = m_fileTrigramsSet[folded / 64];
+		uint64_t bit = (uint64_t) 1 << (folded % 64);
+
+		if (!(word & bit))
 		{
-			delete m_ids[trigram];
-			m_ids[trigram] = NULL;
+			word |= bit;
+			m_fileTrigrams.push_back(folded);
 		}
 	}
 }
 
-void Indexer::write()
+void Indexer::commitFileTrigrams(uint32_t fileId)
 {
-	m_filesFile.write(m_fileList.c_str(), m_fileList.size()*sizeof(char));
-	m_filesFile.flush();
+	if (m_caseFolded)
+		addFoldedTrigrams();
 
-	Index index;
-	index.offset = m_dataFile.tell();
+	// adding in trigrams order visits the table pages sequentially
+	sort(m_fileTrigrams.begin(), m_fileTrigrams.end());
 
-	for (uint32_t trigram = 0; trigram < TRIGRAMS_NO; trigram++)
+	// 0 is not a trigram, scanner uses it as filler
+	for (uint32_t trigram : m_fileTrigrams)
 	{
-		CompressedIds *ids = m_ids[trigram];
-		if (ids == NULL || ids->empty())
-			continue;
+		if (trigram != 0)
+			m_size += m_trigrams.add(trigram, fileId);
+	}
 
-		index.trigram = trigram;
-		index.lastId = ids->lastId();
-		index.size = ids->size();
+	clearFileTrigrams();
+}
 
-		m_idxFile.writeObj(index);
-		m_dataFile.write(ids->getData(), index.size);
+void Indexer::clearFileTrigrams()
+{
+	for (uint32_t trigram : m_fileTrigrams)
+		m_fileTrigramsSet[trigram / 64] = 0;
 
-		ids->clearChunk();
-		index.offset += index.size;
-	}
+	m_fileTrigrams.clear();
+}
+
+void Indexer::write()
+{
+	if (m_fileId == 0)
+		return;
 
-	m_idxFile.flush();
-	m_dataFile.flush();
+	m_db.writeChunk(m_fileList, m_filesMeta, m_trigrams);
+	m_trigrams.clear();
 
 	m_fileList.clear();
+	m_filesMeta.clear();
+	m_fileId = 0;
 	m_size = 0;
 }
 
-void Indexer::sortDatabase()
+void Indexer::setMemoryLimit(size_t limit)
+{
+	m_memoryLimit = limit;
+}
+
+void Indexer::releaseMemory()
 {
 	write();
-	freeIds();
 
-	File newIdxFile(TRIGRAMS_LIST_PATH, "wb");
-	File newDataFile(TRIGRAMS_DATA_PATH, "wb");
+	m_trigrams.releaseMemory();
+	string().swap(m_fileList);
+	vector<FileMeta>().swap(m_filesMeta);
+	vector<uint32_t>().swap(m_fileTrigrams);
+}
 
-	::sortDatabase(m_idxFile, m_dataFile, newIdxFile, newDataFile);
-	m_chunksSize = newDataFile.size();
+void Indexer::finish()
+{
+	if (m_fileId == 0)
+		return;
 
-	m_idxFile.remove();
-	m_dataFile.remove();
+	m_db.addLastChunk(m_fileList, m_filesMeta, m_trigrams);
 
-	File::remove(m_dir + PATH_DELIMITER + FILE_LIST_PATH, true);
-	m_filesFile.renameAndClose(m_dir + PATH_DELIMITER + FILE_LIST_PATH);
+	m_fileList.clear();
+	m_filesMeta.clear();
+	m_fileId = 0;
+	m_size = 0;
 }
 
 size_t Indexer::size() const
@@ -201,17 +281,36 @@ size_t Indexer::size() const
 	return m_size;
 }
 
-size_t Indexer::filesNo() const
+size_t Indexer::memoryUsage() const
 {
-	return m_fileId;
+	return m_trigrams.memoryUsage()
+		+ m_fileList.size()
+		+ m_filesMeta.size() * sizeof(FileMeta)
+		+ m_buffer.size()
+		+ m_trigramsBuffer.size() * sizeof(uint32_t)
+		+ m_fileTrigrams.capacity() * sizeof(uint32_t)
+		+ m_fileTrigramsSet.size() * sizeof(uint64_t);
 }
 
-size_t Indexer::filesTotalSize() const
+size_t Indexer::fixedMemoryUsage(bool caseFolded, size_t bufferSize)
 {
-	return m_filesTotalSize;
+	return TrigramTable::fixedMemoryUsage()
+		+ max(bufferSize, initBufferSize)
+		+ 2 * initBufferSize * sizeof(uint32_t)
+		+ (caseFolded ? 2 : 1) * TRIGRAMS_NO / 8;
 }
 
-size_t Indexer::chunksSize() const
+bool Indexer::overMemoryLimit() const
 {
-	return m_dataFile.isOpen() ? m_dataFile.size() : m_chunksSize;
+	return m_memoryLimit > 0 && memoryUsage() >= m_memoryLimit;
+}
+
+size_t Indexer::filesNo() const
+{
+	return m_filesNo;
+}
+
+size_t Indexer::filesTotalSize() const
+{
+	return m_filesTotalSize;
 }
@@ -4,49 +4,87 @@
 #include <vector>
 #include <string>
 #include <stdint.h>
-#include "file.h"
-#include "compressedids.h"
+#include "dbwriter.h"
+#include "filemeta.h"
+#include "trigramtable.h"
+#include "trigramscanner.h"
 
 
+/* Indexes files into private trigram table, file IDs are local to current
+ * chunk. Every indexer is intended to be used by single thread, while
+ * many indexers could share one DbWriter. */
 class Indexer
 {
 	public:
-		Indexer(size_t bufferSize = 4*1024*1024);
+		Indexer(DbWriter &db, size_t bufferSize = 4*1024*1024);
 		~Indexer();
 
-		void open(const std::string &dir = ".");
-		void close();
-
 		bool indexFile(const std::string &fname);
 
+		/** Index file content that is already in memory */
+		bool indexData(const std::string &fname, const uint8_t *data,
+				size_t size, int64_t mtime);
+
+		/** Chunk is written before adding file that would exceed the limit,
+		 * 0 means no limit */
+		void setMemoryLimit(size_t limit);
+
 		size_t size() const;
+		size_t memoryUsage() const;
+		bool overMemoryLimit() const;
+
+		/** Memory used by indexer before any file is added, with room for
+		 * trigrams of typical file */
+		static size_t fixedMemoryUsage(bool caseFolded,
+				size_t bufferSize = 4*1024*1024);
 		size_t filesNo() const;
 		size_t filesTotalSize() const;
-		size_t chunksSize() const;
 
 		void write();
-		void sortDatabase();
+
+		/** Pass the last chunk to DbWriter, it is merged from memory, so the
+		 * indexer must be kept until the database is sorted */
+		void finish();
+
+		/** Write chunk and free memory kept for the next ones */
+		void releaseMemory();
 
 	private:
-		uint32_t addFile(const std::string &fname);
-		void addTrigram(uint32_t trigram, uint32_t fileId);
-		void freeIds();
+		bool indexStream(const std::string &fname, int64_t mtime);
+		void startFile();
+		void finishFile(const std::string &fname, size_t fileSize,
+				int64_t mtime);
+
+		bool scanTrigrams(const uint8_t *data, size_t size);
+		uint32_t addFile(const std::string &fname, const FileMeta &meta);
+		void addTrigram(uint32_t trigram);
+		void addFoldedTrigrams();
+		void commitFileTrigrams(uint32_t fileId);
+		void clearFileTrigrams();
 
 	private:
-		CompressedIds **m_ids;
+		DbWriter &m_db;
+
+		TrigramTable m_trigrams;
 		size_t m_size;
+		size_t m_memoryLimit;
+		size_t m_filesNo;
 		size_t m_filesTotalSize;
-		size_t m_chunksSize;
 
 		std::string m_fileList;
+		std::vector<FileMeta> m_filesMeta;
 		uint32_t m_fileId;
 
 		std::vector<uint8_t> m_buffer;
 
-		File m_idxFile;
-		File m_dataFile;
-		File m_filesFile;
-		std::string m_dir;
+		TrigramScanner m_scanner;
+		ContentHash m_hash;
+		std::vector<uint32_t> m_trigramsBuffer;
+
+		// distinct trigrams of currently indexed file
+		std::vector<uint32_t> m_fileTrigrams;
+		std::vector<uint64_t> m_fileTrigramsSet;
+		bool m_caseFolded;
 };
 
 #endif
@@ -0,0 +1,218 @@
+#include "readahead.h"
+#include "file.h"
+#include "dir.h"
+#include <cstring>
+
+using namespace std;
+
+
+// binary files are not prefetched beyond this size
+#define PROBE_SIZE	(32 * 1024)
+
+
+ReadAhead::ReadAhead(size_t depth, size_t memoryLimit)
+	: m_depth(depth > 0 ? depth : 1), m_memoryLimit(memoryLimit),
+	m_memory(0), m_readers(0), m_stop(false)
+{}
+
+ReadAhead::~ReadAhead()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_notFull.notify_all();
+	m_memoryFree.notify_all();
+
+	for (thread &th : m_threads)
+		th.join();
+
+	m_queue.clear();
+}
+
+void ReadAhead::start(const Source &source, unsigned threads)
+{
+	m_source = source;
+	m_readers = threads > 0 ? threads : 1;
+
+	for (unsigned i = 0; i < m_readers; i++)
+		m_threads.emplace_back(&ReadAhead::readFiles, this);
+}
+
+unique_ptr<ReadAhead::Entry> ReadAhead::pop()
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	while (m_queue.empty() && m_readers > 0)
+		m_notEmpty.wait(lock);
+
+	if (m_queue.empty())
+		return unique_ptr<Entry>();
+
+	unique_ptr<Entry> entry = move(m_queue.front());
+	m_queue.pop_front();
+
+	m_notFull.notify_one();
+	return entry;
+}
+
+void ReadAhead::readFiles()
+{
+	string fname;
+
+	while (m_source(fname))
+	{
+		unique_ptr<Entry> entry(new Entry(*this, fname));
+
+		try
+		{
+			entry->open();
+			if (!reserve(entry->m_reserved))
+				break;
+
+			entry->load();
+		}
+		catch (const Error &ex)
+		{
+			entry->m_error.reset(new Error(ex));
+		}
+		catch (const exception &ex)
+		{
+			entry->m_error.reset(new Error(FuncError(ex.what())));
+		}
+
+		{
+			unique_lock<mutex> lock(m_mutex);
+			while (!m_stop && m_queue.size() >= m_depth)
+				m_notFull.wait(lock);
+
+			if (m_stop)
+				break;
+
+			m_queue.push_back(move(entry));
+		}
+
+		m_notEmpty.notify_one();
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_readers--;
+	}
+
+	m_notEmpty.notify_all();
+}
+
+bool ReadAhead::reserve(size_t size)
+{
+	unique_lock<mutex> lock(m_mutex);
+
+	// single file is allowed to exceed the limit, otherwise it would wait
+	// forever
+	while (!m_stop && m_memory > 0 && m_memory + size > m_memoryLimit)
+		m_memoryFree.wait(lock);
+
+	m_memory += size;
+	return !m_stop;
+}
+void ReadAhead::release(size_t size)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_memory -= size;
+	}
+
+	m_memoryFree.notify_all();
+}
+
+
+ReadAhead::Entry::Entry(ReadAhead &owner, const string &fname)
+	: m_owner(owner), m_fname(fname), m_reserved(0), m_mtime(0)
+{}
+
+ReadAhead::Entry::~Entry()
+{
+	if (m_reserved)
+		m_owner.release(m_reserved);
+}
+
+void ReadAhead::Entry::open()
+{
+	size_t limit = m_owner.m_memoryLimit;
+
+	uint64_t size;
+	getFileInfo(m_fname, size, m_mtime);
+
+	if (m_mapped.open(m_fname, MappedFile::SEQUENTIAL))
+	{
+		m_reserved = min(m_mapped.size(), limit);
+	}
+	else
+	{
+		// files that are too big for the buffer are read by the indexer
+		File file(m_fname, "rb");
+		size = file.size();
+		m_reserved = size <= limit ? size : 0;
+	}
+}
+
+void ReadAhead::Entry::load()
+{
+	if (m_mapped.isOpen())
+	{
+		const uint8_t *data = m_mapped.data();
+		size_t probe = min(m_mapped.size(), (size_t) PROBE_SIZE);
+
+		bool binary = true;
+
+		m_mapped.prefetch(probe);
+		if (!MappedFile::guard([&]() {
+					binary = memchr(data, '\0', probe) != NULL;
+				}))
+		{
+			throw ThisError("cannot read file")
+				.add("msg", "file truncated while reading")
+				.add("file", m_fname);
+		}
+
+		if (!binary)
+			m_mapped.prefetch(m_reserved);
+	}
+	else if (m_reserved > 0)
+	{
+		File file(m_fname, "rb");
+		m_buffer.resize(m_reserved);
+		m_buffer.resize(file.readN(m_buffer.data(), 1, m_reserved, false));
+	}
+}
+
+bool ReadAhead::Entry::loaded() const
+{
+	return m_mapped.isOpen() || m_reserved > 0;
+}
+
+const string &ReadAhead::Entry::fileName() const
+{
+	return m_fname;
+}
+
+const uint8_t *ReadAhead::Entry::data() const
+{
+	return m_mapped.isOpen() ? m_mapped.data() : m_buffer.data();
+}
+
+size_t ReadAhead::Entry::size() const
+{
+	return m_mapped.isOpen() ? m_mapped.size() : m_buffer.size();
+}
+
+int64_t ReadAhead::Entry::mtime() const
+{
+	return m_mtime;
+}
+
+const Error *ReadAhead::Entry::error() const
+{
+	return m_error.get();
+}
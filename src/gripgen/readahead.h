@@ -0,0 +1,100 @@
+#ifndef __READ_AHEAD_H__
+#define __READ_AHEAD_H__
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdint.h>
+#include "mappedfile.h"
+#include "error.h"
+
+
+/* Bounded producer/consumer queue of files to index. Reader threads open
+ * files ahead of the indexers and prefetch their content - mapped files are
+ * read by the system in background, other files are read to memory buffers.
+ * Queue is limited by number of files and by amount of prefetched data. */
+class ReadAhead
+{
+	public:
+		class Entry
+		{
+			public:
+				~Entry();
+
+				const std::string &fileName() const;
+				/** File content is available, otherwise file is too big to be
+				 * read ahead and should be read by the indexer */
+				bool loaded() const;
+
+				const uint8_t *data() const;
+				size_t size() const;
+				int64_t mtime() const;
+
+				/** Error that occurred during file reading, if any */
+				const Error *error() const;
+
+			private:
+				Entry(ReadAhead &owner, const std::string &fname);
+				Entry(const Entry &);
+				Entry &operator= (const Entry &);
+
+				void open();
+				void load();
+
+			private:
+				ReadAhead &m_owner;
+				std::string m_fname;
+				MappedFile m_mapped;
+				std::vector<uint8_t> m_buffer;
+				std::unique_ptr<Error> m_error;
+				size_t m_reserved;
+				int64_t m_mtime;
+
+				friend class ReadAhead;
+		};
+
+		/** Provides names of files to read, returns false at the end of the
+		 * list. Called concurrently by all reader threads. */
+		typedef std::function<bool (std::string &fname)> Source;
+
+	public:
+		ReadAhead(size_t depth, size_t memoryLimit);
+		~ReadAhead();
+
+		void start(const Source &source, unsigned threads = 1);
+
+		/** Next file in the queue, NULL when there are no more files.
+		 * Prefetched memory is released when entry is destroyed. */
+		std::unique_ptr<Entry> pop();
+
+	private:
+		ReadAhead(const ReadAhead &);
+		ReadAhead &operator= (const ReadAhead &);
+
+		void readFiles();
+		bool reserve(size_t size);
+		void release(size_t size);
+
+	private:
+		size_t m_depth;
+		size_t m_memoryLimit;
+		size_t m_memory;
+
+		Source m_source;
+		std::deque<std::unique_ptr<Entry>> m_queue;
+		std::vector<std::thread> m_threads;
+		unsigned m_readers;
+		bool m_stop;
+
+		std::mutex m_mutex;
+		std::condition_variable m_notFull;		// queue depth
+		std::condition_variable m_memoryFree;	// prefetched data limit
+		std::condition_variable m_notEmpty;
+};
+
+#endif
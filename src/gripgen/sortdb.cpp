@@ -1,91 +1,530 @@
-#include "indexer.h"
-#include "index.h"
+#include "sortdb.h"
+#include "indexwriter.h"
+#include "indextable.h"
 #include "file.h"
-#include <map>
-#include <vector>
+#include "compressedids.h"
+#include "error.h"
+#include <queue>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
 
 using namespace std;
 
 
-typedef vector<Index> Chunks;
-typedef map<uint32_t /* trigram */, Chunks> Trigrams;
+#define MIN_RUN_BUFFER_SIZE	(64 * 1024)
 
 
-static void readTrigrams(File &idxFile, Trigrams &trigrams);
-static size_t getLongestTrigramSize(const Trigrams &trigrams);
-static size_t readChunksData(const Chunks &chunks, File &dataFile,
-		uint8_t *result, uint32_t &lastId);
+/* Lists of single run, in trigrams order */
+class RunReader
+{
+	public:
+		virtual ~RunReader() {}
+
+		virtual bool end() const = 0;
+		virtual const RunIndex &index() const = 0;
 
+		/** Data of current list (index().size bytes) */
+		virtual const uint8_t *data() = 0;
 
-void sortDatabase(File &oldIdxFile, File &oldDataFile, File &newIdxFile,
-		File &newDataFile)
+		virtual void next() = 0;
+};
+
+/* Sequential reader of single sorted run. Indexes and lists data are read
+ * in large blocks, so only one seek is made per block. */
+class FileRunReader : public RunReader
 {
-	Trigrams trigrams;
-	readTrigrams(oldIdxFile, trigrams);
+	public:
+		FileRunReader(const SortedRun &run, File &idxFile, File &dataFile,
+				size_t bufferSize);
 
-	vector<uint8_t> buffer;
-	buffer.resize(getLongestTrigramSize(trigrams));
-	uint8_t *data = buffer.data();
+		virtual bool end() const
+		{
+			return m_pos >= m_indexesNo;
+		}
 
-	Index index;
-	index.offset = newDataFile.tell();
+		virtual const RunIndex &index() const
+		{
+			return m_indexes[m_pos];
+		}
 
-	for (Trigrams::const_iterator it = trigrams.begin();
-			it != trigrams.end(); ++it)
-	{
-		const Chunks &chunks = it->second;
-		index.trigram = it->first;
-		index.size = readChunksData(chunks, oldDataFile, data, index.lastId);
+		virtual const uint8_t *data();
+		virtual void next();
+
+	private:
+		void readIndexes();
+
+	private:
+		const SortedRun &m_run;
+		File &m_idxFile;
+		File &m_dataFile;
+		size_t m_bufferSize;
+
+		vector<RunIndex> m_indexes;
+		size_t m_indexesRead;
+		size_t m_indexesNo;
+		size_t m_pos;
+
+		vector<uint8_t> m_data;
+		size_t m_dataOffset;
+		size_t m_dataSize;
+};
+
+/* Reader of single partition of table run, lists are converted to database
+ * format when it is other than the table one */
+class TableRunReader : public RunReader
+{
+	public:
+		TableRunReader(const TableRun &run, unsigned partition,
+				CompressedIds::Format format);
+
+		virtual bool end() const
+		{
+			return m_it.end() || trigramPartition(m_it.trigram()) != m_partition;
+		}
+
+		virtual const RunIndex &index() const
+		{
+			return m_index;
+		}
+
+		virtual const uint8_t *data();
+		virtual void next();
+
+	private:
+		void readIndex();
 
-		newDataFile.write(data, index.size);
-		newIdxFile.writeObj(index);
-		index.offset += index.size;
+	private:
+		TrigramTable::iterator m_it;
+		unsigned m_partition;
+		uint32_t m_baseId;
+		CompressedIds::Format m_format;
+
+		RunIndex m_index;
+		size_t m_headSize;
+		size_t m_listSize;
+		vector<uint8_t> m_list;
+		vector<uint8_t> m_data;
+};
+
+typedef vector<unique_ptr<RunReader>> RunReaders;
+
+
+static size_t headSize(uint32_t delta)
+{
+	uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+	return CompressedIds::encodeDelta(delta, head);
+}
+
+
+FileRunReader::FileRunReader(const SortedRun &run, File &idxFile,
+		File &dataFile, size_t bufferSize)
+	: m_run(run), m_idxFile(idxFile), m_dataFile(dataFile),
+	m_bufferSize(bufferSize), m_indexesRead(0), m_indexesNo(0), m_pos(0),
+	m_dataOffset(0), m_dataSize(0)
+{
+	size_t indexesNo = max(bufferSize / 4 / sizeof(RunIndex), (size_t) 1);
+	m_indexes.resize(min(indexesNo, run.indexesNo));
+	readIndexes();
+}
+
+void FileRunReader::readIndexes()
+{
+	size_t no = min(m_indexes.size(), m_run.indexesNo - m_indexesRead);
+
+	if (no > 0)
+	{
+		m_idxFile.seek((m_run.indexOffset + m_indexesRead) * sizeof(RunIndex));
+		m_idxFile.read(m_indexes.data(), no * sizeof(RunIndex));
 	}
+
+	m_indexesRead += no;
+	m_indexesNo = no;
+	m_pos = 0;
 }
 
-void readTrigrams(File &idxFile, Trigrams &trigrams)
+const uint8_t *FileRunReader::data()
 {
-	Index index;
-	idxFile.seek(0);
+	const RunIndex &idx = index();
 
-	while (idxFile.readObj(index, false))
+	if (idx.offset < m_dataOffset ||
+			idx.offset + idx.size > m_dataOffset + m_dataSize)
 	{
-		trigrams[index.trigram].push_back(index);
+		// lists are stored in order, read as much of following ones as fits
+		size_t runEnd = m_run.dataOffset + m_run.dataSize;
+		size_t size = max(min(m_bufferSize, runEnd - idx.offset), idx.size);
+		if (m_data.size() < size)
+			m_data.resize(size);
+
+		m_dataFile.seek(idx.offset);
+		m_dataFile.read(m_data.data(), size);
+		m_dataOffset = idx.offset;
+		m_dataSize = size;
 	}
+
+	return m_data.data() + idx.offset - m_dataOffset;
+}
+
+void FileRunReader::next()
+{
+	if (++m_pos >= m_indexesNo)
+		readIndexes();
 }
 
-size_t getLongestTrigramSize(const Trigrams &trigrams)
+
+TableRunReader::TableRunReader(const TableRun &run, unsigned partition,
+		CompressedIds::Format format)
+	: m_it(run.trigrams->lowerBound(partition << 16)), m_partition(partition),
+	m_baseId(run.baseId), m_format(format)
 {
-	size_t maxSize = 0;
+	readIndex();
+}
 
-	for (Trigrams::const_iterator it = trigrams.begin();
-			it != trigrams.end(); ++it)
+void TableRunReader::readIndex()
+{
+	if (end())
+		return;
+
+	// first ID is stored relatively to the chunk, make it absolute
+	uint32_t firstId = m_it.firstId();
+	m_headSize = headSize(firstId);
+	m_listSize = m_it.size();
+
+	// converted list is needed to know its size
+	if (m_format == CompressedIds::BLOCKS)
 	{
-		size_t size = 0;
-		for (const Index &chunk: it->second)
-			size += chunk.size;
+		m_data.resize(m_listSize);
+		m_it.copyData(m_data.data());
+		CompressedIds::toBlocks(m_data.data(), m_listSize, m_list);
+		m_listSize = m_list.size();
+	}
+
+	m_index.trigram = m_it.trigram();
+	m_index.firstId = m_baseId + firstId;
+	m_index.lastId = m_baseId + m_it.lastId();
+	m_index.offset = 0;
+	m_index.size = headSize(m_index.firstId) + m_listSize - m_headSize;
+}
+
+const uint8_t *TableRunReader::data()
+{
+	// list is copied behind space reserved for the longest head
+	size_t size = m_listSize;
+	if (m_data.size() < size + CompressedIds::MAX_DELTA_SIZE)
+		m_data.resize(size + CompressedIds::MAX_DELTA_SIZE);
+
+	uint8_t *data = m_data.data() + CompressedIds::MAX_DELTA_SIZE;
+	if (m_format == CompressedIds::BLOCKS)
+		copy(m_list.begin(), m_list.end(), data);
+	else
+		m_it.copyData(data);
+
+	size_t newHeadSize = m_index.size - (size - m_headSize);
+	data += m_headSize - newHeadSize;
+	CompressedIds::encodeDelta(m_index.firstId, data);
+	return data;
+}
+
+void TableRunReader::next()
+{
+	++m_it;
+	readIndex();
+}
+
 
-		if (size > maxSize)
-			maxSize = size;
+typedef pair<uint32_t /* trigram */, size_t /* run */> HeapEntry;
+typedef priority_queue<HeapEntry, vector<HeapEntry>, greater<HeapEntry>>
+	Heap;
+
+
+static void openRuns(RunReaders &readers, const SortedRuns &runs,
+		const TableRuns &tables, unsigned partition,
+		CompressedIds::Format format, File &idxFile, File &dataFile,
+		size_t bufferSize)
+{
+	size_t runBufferSize = bufferSize / max(runs.size(), (size_t) 1);
+	if (runBufferSize < MIN_RUN_BUFFER_SIZE)
+		runBufferSize = MIN_RUN_BUFFER_SIZE;
+
+	readers.clear();
+	for (const SortedRun &run : runs)
+	{
+		readers.emplace_back(new FileRunReader(run, idxFile, dataFile,
+					runBufferSize));
 	}
 
-	return maxSize;
+	for (const TableRun &table : tables)
+		readers.emplace_back(new TableRunReader(table, partition, format));
 }
 
-size_t readChunksData(const Chunks &chunks, File &dataFile, uint8_t *data,
-		uint32_t &lastId)
+/* Visits lists in trigrams order, lists of the same trigram are visited in
+ * runs order, so with ascending IDs. func(reader, first) is called with first
+ * set for the first list of every trigram. */
+template <typename Func>
+static void mergeRuns(RunReaders &readers, Func func)
 {
-	size_t read = 0;
+	Heap heap;
+
+	for (size_t run = 0; run < readers.size(); run++)
+	{
+		if (!readers[run]->end())
+			heap.push(HeapEntry(readers[run]->index().trigram, run));
+	}
+
+	uint32_t trigram = 0;
+	bool started = false;
 
-	for (const Index &chunk : chunks)
+	while (!heap.empty())
 	{
-		dataFile.seek(chunk.offset);
-		dataFile.read(data + read, chunk.size);
+		size_t run = heap.top().second;
+		RunReader &reader = *readers[run];
+		heap.pop();
+
+		bool first = !started || reader.index().trigram != trigram;
+		trigram = reader.index().trigram;
+		started = true;
+
+		func(reader, first);
+
+		reader.next();
+		if (!reader.end())
+			heap.push(HeapEntry(reader.index().trigram, run));
+	}
+}
+
+/* Computes size of merged partition and number of its non-empty buckets
+ * from indexes only */
+static void measurePartition(RunReaders &readers, SortedRun &out,
+		size_t &bucketsNo)
+{
+	uint32_t lastId = 0;
+	uint32_t bucket = 0;
+	out.indexesNo = 0;
+	out.dataSize = 0;
+	bucketsNo = 0;
+
+	mergeRuns(readers, [&](RunReader &reader, bool first) {
+			const RunIndex &list = reader.index();
+
+			if (first)
+			{
+				if (bucketsNo == 0 || indexBucket(list.trigram) != bucket)
+				{
+					bucket = indexBucket(list.trigram);
+					bucketsNo++;
+				}
+
+				out.indexesNo++;
+				out.dataSize += list.size;
+			}
+			else
+			{
+				out.dataSize += list.size - headSize(list.firstId)
+					+ headSize(list.firstId - lastId);
+			}
+
+			lastId = list.lastId;
+		});
+}
+
+static void writePartition(RunReaders &readers, const SortedRun &out,
+		unsigned partition, IndexWriter &newIdxFile, File &newDataFile)
+{
+	Index index;
+	index.offset = out.dataOffset;
+	index.size = 0;
+	index.complement = false;
+
+	newIdxFile.startRange(partition * PARTITION_BUCKETS, out.indexOffset);
+	newDataFile.seek(out.dataOffset);
+
+	mergeRuns(readers, [&](RunReader &reader, bool first) {
+			const RunIndex &list = reader.index();
+			const uint8_t *data = reader.data();
+
+			if (first)
+			{
+				if (index.size > 0)
+				{
+					newIdxFile.write(index);
+					index.offset += index.size;
+				}
+
+				newDataFile.write(data, list.size);
+				index.trigram = list.trigram;
+				index.size = list.size;
+			}
+			else
+			{
+				// every run starts with absolute ID, make it relative to the
+				// last ID of preceding run
+				uint32_t firstId;
+				size_t oldHeadSize = CompressedIds::decodeDelta(data, list.size,
+						firstId);
+
+				uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+				size_t headSize = CompressedIds::encodeDelta(
+						firstId - index.lastId, head);
+
+				newDataFile.write(head, headSize);
+				newDataFile.write(data + oldHeadSize, list.size - oldHeadSize);
+				index.size += headSize + list.size - oldHeadSize;
+			}
+
+			index.lastId = list.lastId;
+		});
+
+	if (index.size > 0)
+		newIdxFile.write(index);
+
+	newIdxFile.finishRange((partition + 1) * PARTITION_BUCKETS);
+}
+
+/* Runs func in threadsNo threads, the first error is rethrown when all of
+ * them are finished. Work is expected to be shared dynamically, so threads
+ * that could not be started are skipped. */
+static void runThreads(const function<void ()> &func, unsigned threadsNo)
+{
+	unique_ptr<Error> error;
+	mutex errorMutex;
+
+	auto setError = [&](const Error &ex) {
+			lock_guard<mutex> lock(errorMutex);
+			if (!error)
+				error.reset(new Error(ex));
+		};
 
-		read += chunk.size;
-		lastId = chunk.lastId;
+	auto worker = [&]() {
+			try
+			{
+				func();
+			}
+			catch (const Error &ex)
+			{
+				setError(ex);
+			}
+			catch (const exception &ex)
+			{
+				setError(FuncError(ex.what()));
+			}
+		};
+
+	vector<thread> threads;
+
+	try
+	{
+		for (unsigned i = 1; i < threadsNo; i++)
+			threads.emplace_back(worker);
+	}
+	catch (const exception &)
+	{
+		// the rest of work is done by threads already started
 	}
 
-	return read;
+	worker();
+
+	for (thread &th : threads)
+		th.join();
+
+	if (error)
+		throw *error;
 }
 
+void sortDatabase(uint32_t flags, uint32_t firstId, uint32_t endId,
+		uint32_t stopGrams, const vector<SortedRuns> &partitions,
+		const TableRuns &tables, const string &oldIdxPath, const string &oldDataPath,
+		const string &newIdxPath, const string &newDataPath,
+		size_t bufferSize, unsigned threadsNo)
+{
+	threadsNo = max(min(threadsNo, (unsigned) partitions.size()), 1u);
+	bufferSize /= threadsNo;
+
+	vector<SortedRun> outputs(partitions.size());
+	vector<size_t> bucketsNo(partitions.size());
+	atomic<size_t> next(0);
+
+	CompressedIds::Format format = flags & INDEX_BLOCK_LISTS ?
+		CompressedIds::BLOCKS : CompressedIds::VARINT;
+
+	// pages of tables are sorted before they are shared by threads
+	for (const TableRun &table : tables)
+		table.trigrams->begin();
+
+	// sizes of merged partitions are computed first, so every one could be
+	// written independently at its final offset
+	runThreads([&]() {
+			File idxFile(oldIdxPath, "rb");
+			RunReaders readers;
+
+			// lists data is not read here
+			for (size_t no; (no = next++) < partitions.size(); )
+			{
+				openRuns(readers, partitions[no], tables, no, format, idxFile,
+						idxFile, bufferSize);
+				measurePartition(readers, outputs[no], bucketsNo[no]);
+			}
+		}, threadsNo);
+
+	size_t indexOffset = 0;
+	size_t dataOffset = 0;
+	size_t usedBuckets = 0;
+
+	for (size_t no = 0; no < outputs.size(); no++)
+	{
+		SortedRun &out = outputs[no];
+		out.indexOffset = indexOffset;
+		out.dataOffset = dataOffset;
+		indexOffset += out.indexesNo;
+		dataOffset += out.dataSize;
+		usedBuckets += bucketsNo[no];
+	}
+
+	// output files are created before being shared by threads
+	File(newIdxPath, "wb").close();
+	File(newDataPath, "wb").close();
+	next = 0;
+
+	auto writePartitions = [&](IndexWriter &newIdxFile) {
+			File idxFile(oldIdxPath, "rb");
+			File dataFile(oldDataPath, "rb");
+			File newDataFile(newDataPath, "r+b");
+			RunReaders readers;
+
+			for (size_t no; (no = next++) < partitions.size(); )
+			{
+				openRuns(readers, partitions[no], tables, no, format, idxFile,
+						dataFile, bufferSize);
+				writePartition(readers, outputs[no], no, newIdxFile,
+						newDataFile);
+			}
+		};
+
+	IndexWriter newIdxFile(newIdxPath, flags, "r+b");
+
+	if (usedBuckets < indexSparseLimit(flags))
+	{
+		// small index is written by single writer, so its bucket table could
+		// be sparse (see IndexWriter)
+		writePartitions(newIdxFile);
+	}
+	else
+	{
+		newIdxFile.setEntriesNo(indexOffset);
+
+		runThreads([&]() {
+				IndexWriter partIdxFile(newIdxPath, flags, "r+b");
+				partIdxFile.setEntriesNo(indexOffset);
+				writePartitions(partIdxFile);
+			}, threadsNo);
+
+		// partitions cover all buckets, only header and end of data are left
+		newIdxFile.startRange(newIdxFile.bucketsNo(), indexOffset);
+	}
+
+	newIdxFile.setIdsRange(firstId, endId);
+	newIdxFile.setStopGrams(stopGrams);
+	newIdxFile.finish(dataOffset);
+}
@@ -0,0 +1,78 @@
+#ifndef __SORT_DB_H__
+#define __SORT_DB_H__
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include "index.h"
+#include "indextable.h"
+#include "trigramtable.h"
+
+
+/* Trigrams are split to partitions by their most significant byte, every
+ * partition is merged independently. Case-folded trigrams follow in the
+ * next PARTITIONS_NO partitions. */
+#define PARTITIONS_NO		256
+#define PARTITION_BUCKETS	(INDEX_BUCKETS_NO / PARTITIONS_NO)
+
+inline unsigned trigramPartition(uint32_t trigram)
+{
+	return trigram >> 16;
+}
+
+/** Number of partitions of index with given flags */
+inline unsigned partitionsNo(uint32_t flags)
+{
+	return indexBucketsNo(flags) / PARTITION_BUCKETS;
+}
+
+
+/* Index of temporary list, its first ID is kept to compute size of merged
+ * list without reading its data */
+struct RunIndex : public Index
+{
+	uint32_t firstId;
+};
+
+/* Part of temporary index written at once, its indexes are sorted by
+ * trigram and data of consecutive lists is stored contiguously */
+struct SortedRun
+{
+	size_t indexOffset;		// position of the first index record
+	size_t indexesNo;
+	size_t dataOffset;
+	size_t dataSize;
+};
+
+/* Runs of single partition, ordered by their file IDs */
+typedef std::vector<SortedRun> SortedRuns;
+
+/* Chunk kept in memory instead of temporary index, IDs of the table are
+ * relative to baseId */
+struct TableRun
+{
+	const TrigramTable *trigrams;
+	uint32_t baseId;
+};
+
+/* Tables ordered by their file IDs, all following IDs of sorted runs */
+typedef std::vector<TableRun> TableRuns;
+
+
+/** Merge sorted runs and tables into the final index, lists of the same
+ * trigram are concatenated in IDs order. There must be partitionsNo(flags)
+ * partitions, they are merged by up to threadsNo threads, each one reading
+ * its runs sequentially. Index with sparse bucket table (see IndexTable) is
+ * written by single thread. At most bufferSize bytes are used for read
+ * buffers.
+ * Range of file IDs and stop-grams threshold are stored in the header, but
+ * lists are never written as complements (see Compactor).
+ */
+void sortDatabase(uint32_t flags, uint32_t firstId, uint32_t endId,
+		uint32_t stopGrams, const std::vector<SortedRuns> &partitions,
+		const TableRuns &tables,
+		const std::string &oldIdxPath, const std::string &oldDataPath,
+		const std::string &newIdxPath, const std::string &newDataPath,
+		size_t bufferSize, unsigned threadsNo);
+
+#endif
@@ -0,0 +1,206 @@
+#include "trigramscanner.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__SSE2__) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define SCAN_SSE2
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+
+/* Vectorized scanners process data in blocks, stopping before the first
+ * block containing '\r' (handled by scalar code). Two bytes preceding data
+ * must be readable and must not be '\r'. Return number of bytes processed. */
+typedef size_t (*ScanFunc)(const uint8_t *data, size_t size, uint32_t *out,
+		bool &binary);
+
+#define SCALAR_BLOCK_SIZE	32
+
+
+static void scanScalar(const uint8_t *data, size_t size, uint32_t *out,
+		uint32_t &trigram, bool &binary)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		uint8_t ch = data[i];
+		out[i] = 0;
+
+		// ignoring windows newline encoding
+		if (ch == '\r')
+			continue;
+
+		if (ch == '\0')
+			binary = true;
+
+		trigram <<= 8;
+		trigram |= ch;
+
+		if (trigram & 0xff0000)
+			out[i] = trigram & 0xffffff;
+
+		// don't keep trigrams with newline symbol in the middle
+		if (ch == '\n')
+			trigram = '\n';
+	}
+}
+
+#ifdef SCAN_SSE2
+
+static size_t scanSse2(const uint8_t *data, size_t size, uint32_t *out,
+		bool &binary)
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i zero = _mm_setzero_si128();
+	__m128i nul = zero;
+
+	size_t pos;
+	for (pos = 0; pos + 16 <= size; pos += 16)
+	{
+		__m128i c0 = _mm_loadu_si128((const __m128i*) (data + pos));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(c0, cr)))
+			break;
+
+		__m128i c1 = _mm_loadu_si128((const __m128i*) (data + pos - 1));
+		__m128i c2 = _mm_loadu_si128((const __m128i*) (data + pos - 2));
+		nul = _mm_or_si128(nul, _mm_cmpeq_epi8(c0, zero));
+
+		// trigrams with newline in the middle are zeroed
+		__m128i skip = _mm_cmpeq_epi8(c1, nl);
+		c0 = _mm_andnot_si128(skip, c0);
+		c1 = _mm_andnot_si128(skip, c1);
+		c2 = _mm_andnot_si128(skip, c2);
+
+		__m128i lo = _mm_unpacklo_epi8(c0, c1);
+		__m128i hi = _mm_unpackhi_epi8(c0, c1);
+		__m128i lo2 = _mm_unpacklo_epi8(c2, zero);
+		__m128i hi2 = _mm_unpackhi_epi8(c2, zero);
+
+		__m128i *dst = (__m128i*) (out + pos);
+		_mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(lo, lo2));
+		_mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo, lo2));
+		_mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi, hi2));
+		_mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi, hi2));
+	}
+
+	if (_mm_movemask_epi8(nul))
+		binary = true;
+
+	return pos;
+}
+
+__attribute__((target("avx2")))
+static size_t scanAvx2(const uint8_t *data, size_t size, uint32_t *out,
+		bool &binary)
+{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i nul = zero;
+
+	size_t pos;
+	for (pos = 0; pos + 32 <= size; pos += 32)
+	{
+		__m256i c0 = _mm256_loadu_si256((const __m256i*) (data + pos));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(c0, cr)))
+			break;
+
+		__m256i c1 = _mm256_loadu_si256((const __m256i*) (data + pos - 1));
+		__m256i c2 = _mm256_loadu_si256((const __m256i*) (data + pos - 2));
+		nul = _mm256_or_si256(nul, _mm256_cmpeq_epi8(c0, zero));
+
+		__m256i skip = _mm256_cmpeq_epi8(c1, nl);
+		c0 = _mm256_andnot_si256(skip, c0);
+		c1 = _mm256_andnot_si256(skip, c1);
+		c2 = _mm256_andnot_si256(skip, c2);
+
+		// unpacking works within 128-bit lanes, so trigrams are stored out of
+		// order - which is fine as they are not required to be ordered
+		__m256i lo = _mm256_unpacklo_epi8(c0, c1);
+		__m256i hi = _mm256_unpackhi_epi8(c0, c1);
+		__m256i lo2 = _mm256_unpacklo_epi8(c2, zero);
+		__m256i hi2 = _mm256_unpackhi_epi8(c2, zero);
+
+		__m256i *dst = (__m256i*) (out + pos);
+		_mm256_storeu_si256(dst + 0, _mm256_unpacklo_epi16(lo, lo2));
+		_mm256_storeu_si256(dst + 1, _mm256_unpackhi_epi16(lo, lo2));
+		_mm256_storeu_si256(dst + 2, _mm256_unpacklo_epi16(hi, hi2));
+		_mm256_storeu_si256(dst + 3, _mm256_unpackhi_epi16(hi, hi2));
+	}
+
+	if (_mm256_movemask_epi8(nul))
+		binary = true;
+
+	return pos;
+}
+
+static ScanFunc selectScanFunc()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return scanAvx2;
+
+	return scanSse2;
+}
+
+static const ScanFunc scanVector = selectScanFunc();
+
+#else
+
+static const ScanFunc scanVector = NULL;
+
+#endif
+
+
+TrigramScanner::TrigramScanner() : m_trigram('\n')
+{}
+
+void TrigramScanner::reset()
+{
+	m_trigram = '\n';
+}
+
+bool TrigramScanner::scan(const uint8_t *data, size_t size, uint32_t *out)
+{
+	bool binary = false;
+	size_t pos = 0;
+
+	while (pos < size)
+	{
+		if (scanVector && pos >= 2 && data[pos-1] != '\r' && data[pos-2] != '\r')
+		{
+			size_t len = scanVector(data + pos, size - pos, out + pos, binary);
+			if (len > 0)
+			{
+				pos += len;
+
+				const uint8_t *end = data + pos;
+				if (end[-1] == '\n')
+					m_trigram = '\n';
+				else
+					m_trigram = (end[-3] << 16) | (end[-2] << 8) | end[-1];
+
+				continue;
+			}
+		}
+
+		size_t len = min(size - pos, (size_t) SCALAR_BLOCK_SIZE);
+		scanScalar(data + pos, len, out + pos, m_trigram, binary);
+		pos += len;
+	}
+
+	return !binary;
+}
+
+bool TrigramScanner::finish(uint32_t &trigram) const
+{
+	if (m_trigram & 0xff00)
+	{
+		trigram = ((m_trigram << 8) | '\n') & 0xffffff;
+		return true;
+	}
+
+	return false;
+}
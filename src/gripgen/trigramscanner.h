@@ -0,0 +1,34 @@
+#ifndef __TRIGRAM_SCANNER_H__
+#define __TRIGRAM_SCANNER_H__
+
+#include <cstddef>
+#include <stdint.h>
+
+
+/* Extracts trigrams from the file content. Windows newline encoding is
+ * ignored and trigrams with newline in the middle are never generated, as we
+ * are grepping whole lines only. File is assumed to start with a newline.
+ * Uses SSE2/AVX2 when available. */
+class TrigramScanner
+{
+	public:
+		TrigramScanner();
+
+		/** Start new file */
+		void reset();
+
+		/** Scan next fragment of the file. For every byte one trigram is
+		 * stored to out (which must be able to hold size elements), trigrams
+		 * are not ordered and 0 value stands for "no trigram here".
+		 * Returns false if zero byte was found (binary file). */
+		bool scan(const uint8_t *data, size_t size, uint32_t *out);
+
+		/** Trigram ending with newline at the end of the file (to ensure '$'
+		 * works properly), returns false if there is none */
+		bool finish(uint32_t &trigram) const;
+
+	private:
+		uint32_t m_trigram;
+};
+
+#endif
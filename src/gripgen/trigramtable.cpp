@@ -0,0 +1,299 @@
+#include "trigramtable.h"
+#include "compressedids.h"
+#include "error.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+
+#define PAGES_NO		0x20000
+#define TRIGRAM_PAGE_SIZE	0x100
+
+#define PAGE_NO(trigram)	(((trigram) >> 8) & 0x1ffff)
+#define PAGE_SLOT(trigram)	((trigram) & 0xff)
+
+#define BLOCK_SIZE		32
+#define SLAB_SIZE		(1024 * 1024)
+#define SLAB_BLOCKS		(SLAB_SIZE / BLOCK_SIZE)
+
+#define BLOCK_DATA_SIZE	(BLOCK_SIZE - sizeof(uint32_t))
+
+
+struct TrigramTable::Block
+{
+	uint32_t next;
+	uint8_t data[BLOCK_DATA_SIZE];
+};
+
+
+TrigramTable::TrigramTable() : m_sorted(true), m_blocksNo(0)
+{
+	m_pages = new uint32_t*[PAGES_NO];
+	memset(m_pages, 0, PAGES_NO*sizeof(uint32_t*));
+}
+
+TrigramTable::~TrigramTable()
+{
+	clear();
+	delete [] m_pages;
+
+	for (Block *slab : m_slabs)
+		delete [] slab;
+}
+
+unsigned TrigramTable::add(uint32_t trigram, uint32_t id)
+{
+	uint32_t *&page = m_pages[PAGE_NO(trigram)];
+	if (page == NULL)
+	{
+		page = new uint32_t[TRIGRAM_PAGE_SIZE];
+		memset(page, 0, TRIGRAM_PAGE_SIZE*sizeof(uint32_t));
+
+		if (!m_usedPages.empty() && m_usedPages.back() > PAGE_NO(trigram))
+			m_sorted = false;
+
+		m_usedPages.push_back(PAGE_NO(trigram));
+	}
+
+	// slot keeps list number increased by one, 0 is an empty slot
+	uint32_t &slot = page[PAGE_SLOT(trigram)];
+	if (slot == 0)
+		slot = newList() + 1;
+
+	List &list = m_lists[slot - 1];
+
+	if (list.size > 0 && id == list.lastId)
+		return 0;
+
+	if (id < list.lastId)
+		throw ThisError("out of order ID").add("ID", id)
+			.add("lastID", list.lastId);
+
+	uint32_t delta = id - list.lastId;
+	list.lastId = id;
+
+	if (list.size > 0 && delta == list.lastDelta)
+	{
+		Block &tail = getBlock(list.tail);
+		uint8_t &last = tail.data[(list.size - 1) % BLOCK_DATA_SIZE];
+
+		uint8_t rep;
+		size_t size = CompressedIds::encodeRepeat(last, &rep);
+
+		if (size > 0)
+			append(list, &rep, size);
+
+		return size;
+	}
+
+	uint8_t data[CompressedIds::MAX_DELTA_SIZE];
+	size_t size = CompressedIds::encodeDelta(delta, data);
+
+	// never repeat the first delta - it is relative to the list base
+	list.lastDelta = list.size > 0 ? delta : 0;
+
+	append(list, data, size);
+	return size;
+}
+
+size_t TrigramTable::trigramsNo() const
+{
+	return m_lists.size();
+}
+
+bool TrigramTable::empty() const
+{
+	return m_lists.empty();
+}
+
+size_t TrigramTable::memoryUsage() const
+{
+	return fixedMemoryUsage()
+		+ m_usedPages.size() * (TRIGRAM_PAGE_SIZE * sizeof(uint32_t) + sizeof(uint32_t))
+		+ m_lists.size() * sizeof(List)
+		+ (size_t) m_blocksNo * BLOCK_SIZE;
+}
+
+size_t TrigramTable::fixedMemoryUsage()
+{
+	return PAGES_NO * sizeof(uint32_t*);
+}
+
+void TrigramTable::clear()
+{
+	for (uint32_t pageNo : m_usedPages)
+	{
+		delete [] m_pages[pageNo];
+		m_pages[pageNo] = NULL;
+	}
+
+	m_usedPages.clear();
+	m_sorted = true;
+
+	m_lists.clear();
+	m_blocksNo = 0;
+}
+
+void TrigramTable::releaseMemory()
+{
+	clear();
+
+	for (Block *slab : m_slabs)
+		delete [] slab;
+
+	m_slabs.clear();
+	vector<uint32_t>().swap(m_usedPages);
+	vector<List>().swap(m_lists);
+}
+
+uint32_t TrigramTable::newList()
+{
+	List list;
+	list.head = list.tail = newBlock();
+	list.size = 0;
+	list.lastId = 0;
+	list.lastDelta = 0;
+
+	m_lists.push_back(list);
+	return m_lists.size() - 1;
+}
+
+uint32_t TrigramTable::newBlock()
+{
+	if (m_blocksNo / SLAB_BLOCKS >= m_slabs.size())
+		m_slabs.push_back(new Block[SLAB_BLOCKS]);
+
+	uint32_t block = m_blocksNo++;
+	getBlock(block).next = 0;
+	return block;
+}
+
+TrigramTable::Block &TrigramTable::getBlock(uint32_t block) const
+{
+	return m_slabs[block / SLAB_BLOCKS][block % SLAB_BLOCKS];
+}
+
+void TrigramTable::append(List &list, const uint8_t *data, size_t size)
+{
+	while (size > 0)
+	{
+		size_t pos = list.size % BLOCK_DATA_SIZE;
+		if (pos == 0 && list.size > 0)
+		{
+			// list head block is allocated with the list
+			uint32_t block = newBlock();
+			getBlock(list.tail).next = block;
+			list.tail = block;
+		}
+
+		size_t len = min(size, BLOCK_DATA_SIZE - pos);
+		memcpy(getBlock(list.tail).data + pos, data, len);
+
+		list.size += len;
+		data += len;
+		size -= len;
+	}
+}
+
+void TrigramTable::sortPages() const
+{
+	if (!m_sorted)
+	{
+		sort(m_usedPages.begin(), m_usedPages.end());
+		m_sorted = true;
+	}
+}
+
+TrigramTable::iterator TrigramTable::begin() const
+{
+	sortPages();
+	return iterator(*this);
+}
+
+
+TrigramTable::iterator TrigramTable::lowerBound(uint32_t trigram) const
+{
+	sortPages();
+
+	uint32_t pageNo = PAGE_NO(trigram);
+	auto it = lower_bound(m_usedPages.begin(), m_usedPages.end(), pageNo);
+	unsigned slot = it != m_usedPages.end() && *it == pageNo ?
+		PAGE_SLOT(trigram) : 0;
+
+	return iterator(*this, it - m_usedPages.begin(), slot);
+}
+
+
+TrigramTable::iterator::iterator(const TrigramTable &table, size_t page,
+		unsigned slot)
+	: m_table(table), m_page(page), m_slot(slot)
+{
+	skipEmpty();
+}
+
+uint32_t TrigramTable::iterator::trigram() const
+{
+	return (m_table.m_usedPages[m_page] << 8) | m_slot;
+}
+
+uint32_t TrigramTable::iterator::firstId() const
+{
+	// head delta always fits in the first block
+	const List &l = list();
+	uint32_t id;
+	CompressedIds::decodeDelta(m_table.getBlock(l.head).data, l.size, id);
+	return id;
+}
+
+uint32_t TrigramTable::iterator::lastId() const
+{
+	return list().lastId;
+}
+
+size_t TrigramTable::iterator::size() const
+{
+	return list().size;
+}
+
+void TrigramTable::iterator::copyData(uint8_t *data) const
+{
+	const List &l = list();
+	uint32_t block = l.head;
+
+	for (size_t pos = 0; pos < l.size; pos += BLOCK_DATA_SIZE)
+	{
+		const Block &b = m_table.getBlock(block);
+		memcpy(data + pos, b.data, min(l.size - pos, BLOCK_DATA_SIZE));
+		block = b.next;
+	}
+}
+
+TrigramTable::iterator &TrigramTable::iterator::operator++()
+{
+	m_slot++;
+	skipEmpty();
+	return *this;
+}
+
+const TrigramTable::List &TrigramTable::iterator::list() const
+{
+	return m_table.m_lists[m_table.m_pages[m_table.m_usedPages[m_page]][m_slot] - 1];
+}
+
+void TrigramTable::iterator::skipEmpty()
+{
+	while (m_page < m_table.m_usedPages.size())
+	{
+		const uint32_t *page = m_table.m_pages[m_table.m_usedPages[m_page]];
+
+		for (; m_slot < TRIGRAM_PAGE_SIZE; m_slot++)
+		{
+			if (page[m_slot] != 0)
+				return;
+		}
+
+		m_page++;
+		m_slot = 0;
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef __TRIGRAM_TABLE_H__
+#define __TRIGRAM_TABLE_H__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+/* Sparse map of trigrams to their IDs lists. Trigrams are split to pages by
+ * all but the least significant byte (including case-folded trigram bit) and
+ * only pages with at least one trigram are allocated.
+ * Lists are encoded the same way as CompressedIds, but their data is kept in
+ * chains of fixed-size blocks allocated from large slabs. Slabs are reused
+ * after clear(), so steady indexing does not hit the heap for list data. */
+class TrigramTable
+{
+	public:
+		TrigramTable();
+		~TrigramTable();
+
+		/** Add ID to the trigram list, must be greater or equal than the last
+		 * ID of this list. Returns number of bytes added to the list data */
+		unsigned add(uint32_t trigram, uint32_t id);
+
+		size_t trigramsNo() const;
+		bool empty() const;
+
+		/** Memory needed by current content, allocations retained after
+		 * clear() are reused and not counted */
+		size_t memoryUsage() const;
+
+		/** Memory used by empty table */
+		static size_t fixedMemoryUsage();
+
+		/** Remove all trigrams, only touched pages are visited */
+		void clear();
+
+		/** Remove all trigrams and free memory kept for reuse */
+		void releaseMemory();
+
+	private:
+		struct List
+		{
+			uint32_t head;
+			uint32_t tail;
+			uint32_t size;
+			uint32_t lastId;
+			uint32_t lastDelta;
+		};
+
+		struct Block;
+
+	public:
+		class iterator
+		{
+			public:
+				iterator(const TrigramTable &table, size_t page = 0,
+						unsigned slot = 0);
+
+				uint32_t trigram() const;
+				uint32_t firstId() const;
+				uint32_t lastId() const;
+				size_t size() const;
+
+				/** Copy list data (size() bytes) to the buffer */
+				void copyData(uint8_t *data) const;
+
+				iterator &operator++();
+
+				bool end() const
+				{
+					return m_page >= m_table.m_usedPages.size();
+				}
+
+			private:
+				void skipEmpty();
+				const List &list() const;
+
+			private:
+				const TrigramTable &m_table;
+				size_t m_page;
+				unsigned m_slot;
+		};
+
+		/** Iterate over trigrams in ascending order */
+		iterator begin() const;
+
+		/** Iterate from the first trigram not less than given one. Iterators
+		 * could be used concurrently once the table was iterated (its pages
+		 * are sorted then) */
+		iterator lowerBound(uint32_t trigram) const;
+
+	private:
+		TrigramTable(const TrigramTable &);
+		TrigramTable &operator= (const TrigramTable &);
+
+		uint32_t newList();
+		uint32_t newBlock();
+		Block &getBlock(uint32_t block) const;
+		void append(List &list, const uint8_t *data, size_t size);
+
+		void sortPages() const;
+
+	private:
+		uint32_t **m_pages;
+		mutable std::vector<uint32_t> m_usedPages;
+		mutable bool m_sorted;
+
+		std::vector<List> m_lists;
+
+		std::vector<Block*> m_slabs;
+		uint32_t m_blocksNo;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "catch2/catch.hpp"
+#include "../gripgen/compactor.h"
+#include "ids.h"
+#include "index.h"
+#include "indextable.h"
+#include "indexwriter.h"
+#include "filetable.h"
+#include "segments.h"
+#include "dbreader.h"
+#include "file.h"
+#include "dir.h"
+#include "config.h"
+#include "tempdir.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+
+#define TRIGRAM(a, b, c)	((uint32_t) (a) << 16 | (b) << 8 | (c))
+
+struct SegmentList
+{
+	uint32_t trigram;
+	vector<uint32_t> ids;
+	bool complement;
+};
+
+static void writeSegment(const string &dir, uint32_t segment, uint32_t flags,
+		uint32_t firstId, uint32_t endId, uint32_t stopGrams,
+		const vector<SegmentList> &lists)
+{
+	string idxPath = Segments::indexPath(dir, segment);
+	string dataPath = Segments::dataPath(dir, segment);
+
+	IndexWriter idxFile(idxPath + TMP_SUFFIX, flags);
+	idxFile.setIdsRange(firstId, endId);
+	idxFile.setStopGrams(stopGrams);
+	File dataFile(dataPath + TMP_SUFFIX, "wb");
+
+	size_t offset = 0;
+	for (const SegmentList &list : lists)
+	{
+		CompressedIds ids;
+		for (uint32_t id : list.ids)
+			ids.add(id);
+
+		dataFile.write(ids.getData(), ids.size());
+		idxFile.write(Index(list.trigram, offset, ids.size(), ids.lastId(),
+					list.complement));
+		offset += ids.size();
+	}
+
+	idxFile.finish(offset);
+	idxFile.renameAndClose(idxPath);
+	dataFile.renameAndClose(dataPath);
+}
+
+/* Files 0-7 in two segments, file 5 is removed. Segments have stop-grams
+ * thresholds 50% and 60%, only the first one has case-folded trigrams unless
+ * bothFolded is set. */
+static void writeDatabase(const string &dir, bool bothFolded)
+{
+	makeDirectory(dir + PATH_DELIMITER + GRIP_DIR);
+
+	FileTableWriter files(dir + PATH_DELIMITER + FILE_LIST_PATH_TMP);
+	for (const char *name : { "a", "b", "c", "d", "e", "", "g", "h" })
+		files.add(name);
+
+	files.finish();
+	files.renameAndClose(dir + PATH_DELIMITER + FILE_LIST_PATH);
+
+	writeSegment(dir, 0, INDEX_CASE_FOLDED, 0, 4, 50, {
+			{ TRIGRAM('a', 'b', 'c'), IDS(2), true },
+			{ TRIGRAM('q', 'q', 'q'), IDS(0, 1, 2, 3), false },
+			{ TRIGRAM('x', 'y', 'z'), IDS(1), false },
+			{ TRIGRAM('a', 'b', 'c') | TRIGRAM_FOLDED, IDS(0, 1, 3), false },
+		});
+
+	vector<SegmentList> lists = {
+			{ TRIGRAM('a', 'b', 'c'), IDS(4, 5, 7), false },
+			{ TRIGRAM('m', 'm', 'm'), IDS(6), true },
+			{ TRIGRAM('x', 'y', 'z'), IDS(5, 6), false },
+		};
+
+	if (bothFolded)
+	{
+		lists.push_back({ TRIGRAM('a', 'b', 'c') | TRIGRAM_FOLDED, IDS(7),
+				false });
+	}
+
+	writeSegment(dir, 1, bothFolded ? INDEX_CASE_FOLDED : 0, 4, 8, 60, lists);
+
+	Segments segments;
+	segments.add(0);
+	segments.add(1);
+	segments.write(dir);
+}
+
+static bool isComplement(const IndexTable &table, uint32_t trigram)
+{
+	Index index;
+	REQUIRE( table.find(trigram, index) );
+	return index.complement;
+}
+
+TEST_CASE("Segments compaction", "[Compactor]")
+{
+	TempDir dir;
+
+	SECTION("Merging segments", "[Compactor]")
+	{
+		writeDatabase(dir.path(), false);
+
+		Compactor compactor(dir.path());
+		REQUIRE( compactor.segmentsNo() == 2 );
+		REQUIRE( compactor.compact(true) == 2 );
+		REQUIRE( compactor.segmentsNo() == 1 );
+
+		IndexTable table;
+		table.read(Segments::indexPath(dir.path(), 2));
+		REQUIRE( table.firstId() == 0 );
+		REQUIRE( table.endId() == 8 );
+		REQUIRE( table.stopGrams() == 50 );
+		REQUIRE( table.flags() == INDEX_SPARSE_BUCKETS );
+
+		// 5 of 7 files: complement in the first segment materialized and
+		// stored as complement again
+		REQUIRE( isComplement(table, TRIGRAM('a', 'b', 'c')) );
+
+		// stop-gram in the second segment only, but not after merge
+		REQUIRE( !isComplement(table, TRIGRAM('m', 'm', 'm')) );
+
+		// regular list in the first segment becomes stop-gram
+		REQUIRE( isComplement(table, TRIGRAM('q', 'q', 'q')) );
+		REQUIRE( !isComplement(table, TRIGRAM('x', 'y', 'z')) );
+
+		// folded trigrams are dropped, the second segment lacks them
+		Index index;
+		REQUIRE( !table.find(TRIGRAM('a', 'b', 'c') | TRIGRAM_FOLDED, index) );
+		REQUIRE( table.size() == 4 );
+
+		DbReader db(dir.path());
+		REQUIRE( db.getSegmentsNo() == 1 );
+		REQUIRE( !db.isCaseFolded() );
+
+		// removed file is neither on regular nor on complement lists, reader
+		// does not filter removed files out of materialized complements
+		REQUIRE( CMP_IDS(db.getComplement(TRIGRAM('a', 'b', 'c')), 2, 6) );
+		REQUIRE( CMP_IDS(db.get(TRIGRAM('a', 'b', 'c')), 0, 1, 3, 4, 5, 7) );
+		REQUIRE( CMP_IDS(db.get(TRIGRAM('m', 'm', 'm')), 4, 7) );
+		REQUIRE( CMP_IDS(db.getComplement(TRIGRAM('q', 'q', 'q')), 4, 6, 7) );
+		REQUIRE( CMP_IDS(db.get(TRIGRAM('q', 'q', 'q')), 0, 1, 2, 3, 5) );
+		REQUIRE( CMP_IDS(db.get(TRIGRAM('x', 'y', 'z')), 1, 6) );
+
+		// old segments are removed
+		uint64_t size;
+		int64_t mtime;
+		string idxPath = Segments::indexPath(dir.path(), 0);
+		string dataPath = Segments::dataPath(dir.path(), 1);
+		REQUIRE( !getFileInfo(idxPath, size, mtime) );
+		REQUIRE( !getFileInfo(dataPath, size, mtime) );
+	}
+
+	SECTION("Keeping case-folded trigrams", "[Compactor]")
+	{
+		writeDatabase(dir.path(), true);
+		REQUIRE( Compactor(dir.path()).compact(true) == 2 );
+
+		IndexTable table;
+		table.read(Segments::indexPath(dir.path(), 2));
+		REQUIRE( table.flags() == (INDEX_CASE_FOLDED | INDEX_SPARSE_BUCKETS) );
+		REQUIRE( table.size() == 5 );
+
+		DbReader db(dir.path());
+		REQUIRE( db.isCaseFolded() );
+		REQUIRE( CMP_IDS(db.get(TRIGRAM('a', 'b', 'c') | TRIGRAM_FOLDED),
+					0, 1, 3, 5, 7) );
+	}
+
+	SECTION("Nothing to merge", "[Compactor]")
+	{
+		writeDatabase(dir.path(), false);
+
+		Compactor compactor(dir.path());
+		REQUIRE( compactor.compact(false) == 2 );
+		REQUIRE( compactor.compact(false) == 0 );
+	}
+}
@@ -1,6 +1,9 @@
 #include "catch2/catch.hpp"
 
 #include "ids.h"
+#include <cstring>
+#include <algorithm>
+#include <iterator>
 
 using namespace std;
 
@@ -116,6 +119,39 @@ TEST_CASE("CompressedIds modification", "[CompressedIds]")
 		REQUIRE( ids1.empty() );
 		REQUIRE( ids2.empty() );
 	}
+
+	SECTION("Viewing external data", "[CompressedIds]")
+	{
+		CompressedIds ids1;
+		ids1.add( 3 );
+		ids1.add( 7 );
+		ids1.add( 11 );
+
+		vector<uint8_t> data(ids1.getData(), ids1.getData() + ids1.size());
+
+		CompressedIds ids2;
+		ids2.setView(data.data(), data.size(), 11);
+		REQUIRE( ids2.isView() );
+		REQUIRE( ids2.getData() == data.data() );
+		REQUIRE( CMP_IDS(ids2, 3, 7, 11) );
+
+		ids2.add( 15 );
+		REQUIRE_FALSE( ids2.isView() );
+		REQUIRE( CMP_IDS(ids2, 3, 7, 11, 15) );
+		REQUIRE( data.size() == ids1.size() );
+
+		CompressedIds ids3;
+		ids3.setView(data.data(), data.size(), 11);
+		ids3.swap(ids1);
+		REQUIRE( ids1.isView() );
+		REQUIRE( CMP_IDS(ids1, 3, 7, 11) );
+
+		ids3.clear();
+		ids3.move(ids1);
+		REQUIRE( ids1.empty() );
+		REQUIRE( ids3.isView() );
+		REQUIRE( CMP_IDS(ids3, 3, 7, 11) );
+	}
 }
 
 TEST_CASE("Ids compression", "[CompressedIds]")
@@ -156,3 +192,280 @@ TEST_CASE("Ids compression", "[CompressedIds]")
 		REQUIRE( compareIds(ids, vec) );
 	}
 }
+
+TEST_CASE("CompressedIds chunks", "[CompressedIds]")
+{
+	SECTION("Encoding deltas", "[CompressedIds]")
+	{
+		uint8_t data[CompressedIds::MAX_DELTA_SIZE];
+
+		for (uint32_t delta : IDS(0, 1, 0x3f, 0x40, 0x1fff, 0x2000,
+					0xfffff, 0x100000, 0x7ffffff, 0x8000000, (uint32_t) -1))
+		{
+			uint32_t decoded;
+			size_t size = CompressedIds::encodeDelta(delta, data);
+			REQUIRE( size <= CompressedIds::MAX_DELTA_SIZE );
+			REQUIRE( CompressedIds::decodeDelta(data, size, decoded) == size );
+			REQUIRE( decoded == delta );
+		}
+
+		data[0] = 0x41;
+		uint32_t decoded;
+		REQUIRE_THROWS_AS( CompressedIds::decodeDelta(data, 1, decoded), Error );
+	}
+
+	SECTION("Re-basing list head", "[CompressedIds]")
+	{
+		CompressedIds ids1;
+		ids1.add( 5 );
+		ids1.add( 10 );
+		ids1.add( 15 );
+		ids1.add( 20 );
+
+		uint32_t firstId;
+		size_t oldSize = CompressedIds::decodeDelta(ids1.getData(),
+				ids1.size(), firstId);
+		REQUIRE( firstId == 5 );
+
+		uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+		size_t headSize = CompressedIds::encodeDelta(firstId + 1000, head);
+
+		CompressedIds ids2;
+		uint8_t *data = ids2.setData(headSize + ids1.size() - oldSize);
+		memcpy(data, head, headSize);
+		memcpy(data + headSize, ids1.getData() + oldSize, ids1.size() - oldSize);
+
+		REQUIRE( CMP_IDS(ids2, 1005, 1010, 1015, 1020) );
+	}
+}
+
+TEST_CASE("CompressedIds blocks", "[CompressedIds]")
+{
+	// deltas of every length, long enough to fill several blocks
+	vector<uint32_t> vec;
+	CompressedIds varint;
+	uint32_t id = 0;
+
+	for (uint32_t i = 0; i < 1000; i++)
+	{
+		id += i % 7 == 0 ? 0x1000000 + i : i % 5 == 0 ? 0x10000 :
+			i % 3 == 0 ? 0x100 : 1;
+		varint.add(id);
+		vec.push_back(id);
+	}
+
+	SECTION("Converting varint list", "[CompressedIds]")
+	{
+		vector<uint8_t> blocks;
+		CompressedIds::toBlocks(varint.getData(), varint.size(), blocks);
+
+		CompressedIds cids;
+		uint8_t *data = cids.setData(blocks.size(), vec.back(),
+				CompressedIds::BLOCKS);
+		memcpy(data, blocks.data(), blocks.size());
+
+		REQUIRE_NOTHROW( cids.validate() );
+		REQUIRE( compareIds(cids, vec) );
+		REQUIRE( cids.firstId() == vec.front() );
+		REQUIRE( cids.hasId(vec[500]) );
+		REQUIRE( !cids.hasId(vec[500] + 1) );
+
+		Ids ids;
+		cids.decompress(ids);
+		REQUIRE( compareIds(ids, vec) );
+
+		// copied iterator keeps its own decoded block
+		CompressedIds::iterator it = cids.begin();
+		for (size_t i = 0; i < 200; i++)
+			++it;
+
+		CompressedIds::iterator copy = it;
+		for (size_t i = 0; i < 200; i++)
+			++it;
+
+		REQUIRE( *copy == vec[200] );
+		REQUIRE( *it == vec[400] );
+		copy = it;
+		REQUIRE( *++copy == vec[401] );
+
+		cids.setView(blocks.data(), blocks.size() - 1, vec.back(),
+				CompressedIds::BLOCKS);
+		REQUIRE_THROWS_AS( cids.validate(), Error );
+	}
+
+	SECTION("Re-basing block list head", "[CompressedIds]")
+	{
+		vector<uint8_t> blocks1, blocks2;
+		encodeIdsBlocks(vec.data(), 300, 0, blocks1);
+		encodeIdsBlocks(vec.data() + 300, vec.size() - 300, 0, blocks2);
+
+		uint32_t firstId;
+		size_t oldSize = CompressedIds::decodeDelta(blocks2.data(),
+				blocks2.size(), firstId);
+		REQUIRE( firstId == vec[300] );
+
+		uint8_t head[CompressedIds::MAX_DELTA_SIZE];
+		size_t headSize = CompressedIds::encodeDelta(firstId - vec[299], head);
+
+		blocks1.insert(blocks1.end(), head, head + headSize);
+		blocks1.insert(blocks1.end(), blocks2.begin() + oldSize, blocks2.end());
+
+		CompressedIds cids;
+		cids.setView(blocks1.data(), blocks1.size(), vec.back(),
+				CompressedIds::BLOCKS);
+
+		REQUIRE_NOTHROW( cids.validate() );
+		REQUIRE( compareIds(cids, vec) );
+	}
+
+	SECTION("Intersecting lists", "[CompressedIds]")
+	{
+		vector<uint8_t> blocks;
+		CompressedIds::toBlocks(varint.getData(), varint.size(), blocks);
+
+		CompressedIds cids;
+		cids.setView(blocks.data(), blocks.size(), vec.back(),
+				CompressedIds::BLOCKS);
+
+		// candidates sparse, dense, out of range and absent from the list
+		vector<uint32_t> candidates;
+		for (uint32_t id : vec)
+		{
+			if (id % 97 < 3 || (id > vec[600] && id < vec[700]))
+				candidates.push_back(id);
+			if (id % 11 == 0)
+				candidates.push_back(id + 1);
+		}
+		candidates.push_back(vec.back() + 1);
+		sort(candidates.begin(), candidates.end());
+		candidates.erase(unique(candidates.begin(), candidates.end()),
+				candidates.end());
+
+		vector<uint32_t> expected;
+		set_intersection(candidates.begin(), candidates.end(),
+				vec.begin(), vec.end(), back_inserter(expected));
+		REQUIRE( !expected.empty() );
+
+		Ids ids1, ids2;
+		for (uint32_t id : candidates)
+		{
+			ids1.add(id);
+			ids2.add(id);
+		}
+
+		cids.commonPart(ids1);
+		varint.commonPart(ids2);
+		REQUIRE( compareIds(ids1, expected) );
+		REQUIRE( compareIds(ids2, expected) );
+
+		REQUIRE( cids.hasId(vec.front()) );
+		REQUIRE( cids.hasId(vec.back()) );
+		REQUIRE( !cids.hasId(vec.front() - 1) );
+		REQUIRE( !cids.hasId(vec.back() + 1) );
+	}
+
+	SECTION("Excluding lists", "[CompressedIds]")
+	{
+		vector<uint8_t> blocks;
+		CompressedIds::toBlocks(varint.getData(), varint.size(), blocks);
+
+		CompressedIds cids;
+		cids.setView(blocks.data(), blocks.size(), vec.back(),
+				CompressedIds::BLOCKS);
+
+		vector<uint32_t> candidates;
+		for (uint32_t i = 0; i < vec.size(); i += 3)
+		{
+			candidates.push_back(vec[i]);
+			candidates.push_back(vec[i] + 1);
+		}
+		candidates.push_back(vec.back() + 1);
+		sort(candidates.begin(), candidates.end());
+		candidates.erase(unique(candidates.begin(), candidates.end()),
+				candidates.end());
+
+		vector<uint32_t> expected;
+		set_difference(candidates.begin(), candidates.end(),
+				vec.begin(), vec.end(), back_inserter(expected));
+		REQUIRE( !expected.empty() );
+
+		Ids ids1, ids2;
+		for (uint32_t id : candidates)
+		{
+			ids1.add(id);
+			ids2.add(id);
+		}
+
+		cids.excludeFrom(ids1);
+		varint.excludeFrom(ids2);
+		REQUIRE( compareIds(ids1, expected) );
+		REQUIRE( compareIds(ids2, expected) );
+
+		Ids ids;
+		CompressedIds().excludeFrom(ids1);
+		varint.excludeFrom(ids);
+		REQUIRE( compareIds(ids1, expected) );
+		REQUIRE( ids.empty() );
+	}
+
+	SECTION("Dense blocks as bitmaps", "[CompressedIds]")
+	{
+		// dense and sparse ranges, so both blocks kinds are mixed
+		vector<uint32_t> dense;
+		uint32_t id = 5;
+		for (uint32_t i = 0; i < 2000; i++)
+		{
+			id += (i / 300) % 2 ? 1000 + i : 1 + i % 3;
+			dense.push_back(id);
+		}
+
+		// deltas are 1 to 3, so bitmap takes less than a byte per ID
+		vector<uint8_t> blocks;
+		encodeIdsBlocks(dense.data(), 300, 0, blocks);
+		REQUIRE( blocks.size() < 300 / 2 );
+
+		CompressedIds cids;
+		cids.setView(blocks.data(), blocks.size(), dense[299],
+				CompressedIds::BLOCKS);
+
+		Ids ids;
+		cids.decompress(ids);
+		REQUIRE( compareIds(ids, vector<uint32_t>(dense.begin(),
+						dense.begin() + 300)) );
+
+		blocks.clear();
+		encodeIdsBlocks(dense.data(), dense.size(), 0, blocks);
+
+		cids.setView(blocks.data(), blocks.size(), dense.back(),
+				CompressedIds::BLOCKS);
+
+		REQUIRE_NOTHROW( cids.validate() );
+		REQUIRE( compareIds(cids, dense) );
+
+		ids.clear();
+		cids.decompress(ids);
+		REQUIRE( compareIds(ids, dense) );
+
+		// neighbours of list IDs hit both set and unset bits
+		vector<uint32_t> candidates, expected;
+		for (uint32_t i = 0; i < dense.size(); i += 7)
+		{
+			candidates.push_back(dense[i] - 1);
+			candidates.push_back(dense[i]);
+		}
+		sort(candidates.begin(), candidates.end());
+		candidates.erase(unique(candidates.begin(), candidates.end()),
+				candidates.end());
+		set_intersection(candidates.begin(), candidates.end(),
+				dense.begin(), dense.end(), back_inserter(expected));
+
+		ids.clear();
+		for (uint32_t id : candidates)
+			ids.add(id);
+
+		cids.commonPart(ids);
+		REQUIRE( compareIds(ids, expected) );
+		REQUIRE( cids.hasId(dense[1000]) );
+		REQUIRE( !cids.hasId(dense[1000] + 1) );
+	}
+}
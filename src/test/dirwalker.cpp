@@ -0,0 +1,143 @@
+#include "catch2/catch.hpp"
+#include "../gripgen/dirwalker.h"
+#include "dir.h"
+#include "file.h"
+#include "tempdir.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+
+/* Tree of files, .gitignore ones included, and files expected to be listed
+ * by walker with given exclude globs */
+struct WalkCase
+{
+	const char *name;
+	vector<pair<string, string>> files;		// path, content
+	vector<string> excludes;
+	bool gitIgnore;
+	vector<string> expected;
+};
+
+static vector<string> walkTree(const WalkCase &test)
+{
+	TempDir dir;
+
+	for (const auto &file : test.files)
+	{
+		string path = dir.path(file.first);
+		boost::filesystem::create_directories(
+				boost::filesystem::path(path).parent_path());
+
+		File(path, "wb").write(file.second.c_str(), file.second.size());
+	}
+
+	DirWalker walker;
+	walker.addRoot(dir.path());
+	walker.useGitIgnore(test.gitIgnore);
+	for (const string &exclude : test.excludes)
+		walker.addExclude(exclude);
+
+	walker.start(2);
+
+	vector<string> res;
+	string prefix = dir.path() + PATH_DELIMITER;
+	string fname;
+
+	while (walker.next(fname))
+	{
+		REQUIRE( fname.compare(0, prefix.size(), prefix) == 0 );
+		res.push_back(fname.substr(prefix.size()));
+	}
+
+	sort(res.begin(), res.end());
+	return res;
+}
+
+TEST_CASE("Directory walker", "[DirWalker]")
+{
+	const vector<WalkCase> cases = {
+		{ "no patterns",
+			{ {"a.c", ""}, {"sub/b.c", ""}, {".grip/files", ""} },
+			{}, true,
+			{ "a.c", "sub/b.c" } },
+
+		{ "names matched at any depth",
+			{ {".gitignore", "*.o\n"}, {"a.o", ""}, {"a.c", ""},
+				{"sub/deep/b.o", ""}, {"sub/deep/b.c", ""} },
+			{}, true,
+			{ ".gitignore", "a.c", "sub/deep/b.c" } },
+
+		{ "comments, blank lines and escapes",
+			{ {".gitignore", "# a.c\n\n\\#b.c\n  \nc.c  \r\n"}, {"a.c", ""},
+				{"#b.c", ""}, {"c.c", ""}, {"d.c", ""} },
+			{}, true,
+			{ ".gitignore", "a.c", "d.c" } },
+
+		{ "anchored patterns",
+			{ {".gitignore", "/build\nsrc/gen/*.c\n"}, {"build/a.c", ""},
+				{"sub/build/b.c", ""}, {"src/gen/c.c", ""},
+				{"src/gen/deep/d.c", ""}, {"gen/e.c", ""} },
+			{}, true,
+			{ ".gitignore", "gen/e.c", "src/gen/deep/d.c",
+				"sub/build/b.c" } },
+
+		{ "directory only patterns",
+			{ {".gitignore", "logs/\n"}, {"logs/a.txt", ""},
+				{"sub/logs/b.txt", ""}, {"other/logs", ""} },
+			{}, true,
+			{ ".gitignore", "other/logs" } },
+
+		{ "negation, the last matching pattern wins",
+			{ {".gitignore", "*.log\n!keep.log\n"}, {"a.log", ""},
+				{"keep.log", ""}, {"sub/keep.log", ""}, {"sub/b.log", ""} },
+			{}, true,
+			{ ".gitignore", "keep.log", "sub/keep.log" } },
+
+		{ "double asterisk",
+			{ {".gitignore", "**/tmp\ndoc/**\na/**/z.txt\n"},
+				{"tmp/a.c", ""}, {"sub/tmp/b.c", ""}, {"doc/c.md", ""},
+				{"doc/deep/d.md", ""}, {"sub/doc/e.md", ""},
+				{"a/b/c/z.txt", ""}, {"a/b/y.txt", ""} },
+			{}, true,
+			{ ".gitignore", "a/b/y.txt", "sub/doc/e.md" } },
+
+		{ "nested files take precedence",
+			{ {".gitignore", "*.o\n/top.c\n"}, {"a.o", ""}, {"top.c", ""},
+				{"sub/.gitignore", "!*.o\n/top.c\n"}, {"sub/b.o", ""},
+				{"sub/top.c", ""}, {"sub/deep/top.c", ""} },
+			{}, true,
+			{ ".gitignore", "sub/.gitignore", "sub/b.o",
+				"sub/deep/top.c" } },
+
+		{ "exclude globs match names",
+			{ {"a.c", ""}, {"a.o", ""}, {"node_modules/x.js", ""},
+				{"sub/node_modules/y.js", ""}, {"sub/b.c", ""} },
+			{ "*.o", "node_modules" }, true,
+			{ "a.c", "sub/b.c" } },
+
+		{ "exclude globs override negation",
+			{ {".gitignore", "!*.o\n"}, {"a.o", ""}, {"a.c", ""} },
+			{ "*.o" }, true,
+			{ ".gitignore", "a.c" } },
+
+		{ "git ignore disabled",
+			{ {".gitignore", "*.o\n"}, {"a.o", ""}, {".git/config", ""},
+				{".grip/files", ""} },
+			{}, false,
+			{ ".git/config", ".gitignore", "a.o" } },
+
+		{ "git directory skipped",
+			{ {".git/config", ""}, {"a.c", ""} },
+			{}, true,
+			{ "a.c" } },
+	};
+
+	for (const WalkCase &test : cases)
+	{
+		INFO( test.name );
+		REQUIRE( walkTree(test) == test.expected );
+	}
+}
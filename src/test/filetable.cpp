@@ -0,0 +1,126 @@
+#include "catch2/catch.hpp"
+#include "filetable.h"
+#include "file.h"
+#include "error.h"
+#include "tempdir.h"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+
+using namespace std;
+
+
+static void writeTable(const string &fname, const vector<string> &names)
+{
+	FileTableWriter writer(fname + ".tmp");
+	for (const string &name : names)
+		writer.add(name);
+
+	writer.finish();
+	writer.renameAndClose(fname);
+}
+
+TEST_CASE("File names table", "[FileTable]")
+{
+	TempDir dir;
+	string fname = dir.path("files");
+
+	SECTION("Reading names back", "[FileTable]")
+	{
+		// shared prefixes, unrelated names, tombstones and names longer than
+		// single byte length, spread over several blocks
+		vector<string> names = {
+			"src/general/ids.cpp", "src/general/ids.h", "src/grip/grip.cpp",
+			"", "src/grip/grep.cpp", "README.md", "", "",
+			"src/general/ids.h", "src/general/ids.h", string(300, 'x'),
+			string(300, 'x') + "y", "x", "", "inc/a.h", "inc/b.h",
+			"inc/c.h", "inc/c.hpp", "", "inc/c.hpp",
+		};
+
+		for (unsigned i = 0; i < 40; i++)
+			names.push_back("dir/file" + to_string(i / 3) + ".txt");
+
+		// block starts with name sharing prefix with the previous block
+		REQUIRE( names[FILE_TABLE_BLOCK] == "inc/c.h" );
+
+		writeTable(fname, names);
+
+		FileTable table;
+		table.read(fname);
+		REQUIRE( table.size() == names.size() );
+		REQUIRE( !table.empty() );
+
+		for (uint32_t id = 0; id < names.size(); id++)
+			REQUIRE( table.get(id) == names[id] );
+
+		// backward, across blocks and repeated
+		vector<uint32_t> ids;
+		for (uint32_t id = 0; id < names.size(); id++)
+			ids.insert(ids.end(), 2, id);
+
+		shuffle(ids.begin(), ids.end(), mt19937(7));
+
+		for (uint32_t id : ids)
+			REQUIRE( table.get(id) == names[id] );
+
+		for (uint32_t id = names.size(); id-- > 0; )
+			REQUIRE( table.get(id) == names[id] );
+
+		REQUIRE_THROWS_AS( table.get(names.size()), Error );
+		REQUIRE( table.get(FILE_TABLE_BLOCK) == names[FILE_TABLE_BLOCK] );
+	}
+
+	SECTION("Block boundaries", "[FileTable]")
+	{
+		for (size_t no : vector<size_t>({ 0, 1, FILE_TABLE_BLOCK - 1,
+					FILE_TABLE_BLOCK, FILE_TABLE_BLOCK + 1,
+					2 * FILE_TABLE_BLOCK }))
+		{
+			vector<string> names;
+			for (size_t i = 0; i < no; i++)
+				names.push_back(i % 5 == 4 ? string() : "a/b" + to_string(i));
+
+			writeTable(fname, names);
+
+			FileTable table;
+			table.read(fname);
+			REQUIRE( table.size() == no );
+			REQUIRE( table.empty() == (no == 0) );
+
+			for (uint32_t id = no; id-- > 0; )
+				REQUIRE( table.get(id) == names[id] );
+		}
+	}
+
+	SECTION("Rejecting malformed table", "[FileTable]")
+	{
+		writeTable(fname, { "a", "b", "c" });
+
+		vector<uint8_t> data;
+		File(fname, "rb").readVector(data);
+
+		FileTable table;
+
+		// other format
+		vector<uint8_t> bad = data;
+		bad[0] ^= 1;
+		File(fname, "wb").writeVector(bad);
+		REQUIRE_THROWS_AS( table.read(fname), Error );
+
+		// blocks offsets do not match number of files
+		bad = data;
+		((FileTableHeader*) bad.data())->filesNo = FILE_TABLE_BLOCK + 1;
+		File(fname, "wb").writeVector(bad);
+		REQUIRE_THROWS_AS( table.read(fname), Error );
+
+		// truncated
+		bad.assign(data.begin(), data.begin() + sizeof(FileTableHeader) - 1);
+		File(fname, "wb").writeVector(bad);
+		REQUIRE_THROWS_AS( table.read(fname), Error );
+
+		File(fname, "wb").writeVector(data);
+		table.read(fname);
+		REQUIRE( table.get(2) == "c" );
+	}
+}
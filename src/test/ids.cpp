@@ -1,5 +1,7 @@
 #include "catch2/catch.hpp"
 #include "ids.h"
+#include <algorithm>
+#include <iterator>
 
 using namespace std;
 
@@ -96,4 +98,42 @@ TEST_CASE("Ids modification", "[Ids]")
 		REQUIRE( ids1.empty() );
 		REQUIRE( ids2.empty() );
 	}
+
+	SECTION("Intersecting Ids", "[Ids]")
+	{
+		// runs of common IDs and gaps, longer than vector registers
+		vector<uint32_t> vec1, vec2, expected;
+		for (uint32_t id = 0; id < 3000; id++)
+		{
+			if (id % 3 == 0 || (id / 100) % 4 == 1)
+				vec1.push_back(id);
+			if (id % 5 == 0 || (id / 100) % 4 == 2 || id > 2900)
+				vec2.push_back(id);
+		}
+		set_intersection(vec1.begin(), vec1.end(), vec2.begin(), vec2.end(),
+				back_inserter(expected));
+
+		Ids ids1, ids2, ids3;
+		for (uint32_t id : vec1)
+			ids1.add(id);
+		for (uint32_t id : vec2)
+			ids2.add(id);
+
+		ids3.commonPart(ids1, ids2);
+		REQUIRE( compareIds(ids3, expected) );
+
+		ids3.commonPart(ids1, ids1);
+		REQUIRE( compareIds(ids3, vec1) );
+
+		// result stored over operand
+		ids3 = ids2;
+		ids3.commonPart(ids1, ids3);
+		REQUIRE( compareIds(ids3, expected) );
+
+		ids1.commonPart(ids2);
+		REQUIRE( compareIds(ids1, expected) );
+
+		ids2.commonPart(Ids());
+		REQUIRE( ids2.empty() );
+	}
 }
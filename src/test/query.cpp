@@ -0,0 +1,51 @@
+#include "catch2/catch.hpp"
+#include "node.h"
+#include "query.h"
+
+using namespace std;
+
+
+static string compileRegex(const char *regex, bool caseSensitive = true,
+		bool caseFolded = false)
+{
+	Node tree;
+	tree.parseRegex(regex, true, caseSensitive);
+
+	Query query;
+	query.compile(tree, caseFolded);
+	return query.toString();
+}
+
+TEST_CASE("Query compilation", "[Query]")
+{
+	SECTION("Intersecting trigrams of path", "[Query]")
+	{
+		REQUIRE( compileRegex("abcd") == "AND(616263 626364)" );
+		REQUIRE( compileRegex("abcabc") == "AND(616263 626361 636162)" );
+		REQUIRE( compileRegex("abc.def") == "AND(616263 646566)" );
+	}
+
+	SECTION("Joining alternatives", "[Query]")
+	{
+		REQUIRE( compileRegex("abc|def") == "OR(616263 646566)" );
+		REQUIRE( compileRegex("abc|abc") == "616263" );
+		REQUIRE( compileRegex("Abc", false) ==
+				"OR(414243 414263 416243 416263 614243 614263 616243 616263)" );
+	}
+
+	SECTION("Hoisting common trigrams", "[Query]")
+	{
+		REQUIRE( compileRegex("abcd|abce") == "AND(616263 OR(626364 626365))" );
+		REQUIRE( compileRegex("foo(bar|baz)") ==
+				"AND(666f6f 6f6261 6f6f62 OR(626172 62617a))" );
+		REQUIRE( compileRegex("abcd|abc") == "616263" );
+	}
+
+	SECTION("Folding trigrams case", "[Query]")
+	{
+		REQUIRE( compileRegex("aBc", true, true) == "1616263" );
+		REQUIRE( compileRegex("Ab123", true, true) ==
+				"AND(1616231 1623132 313233)" );
+		REQUIRE( compileRegex("ABC|abc", true, true) == "1616263" );
+	}
+}
@@ -0,0 +1,220 @@
+#include "catch2/catch.hpp"
+#include "../gripgen/sortdb.h"
+#include "../gripgen/trigramtable.h"
+#include "ids.h"
+#include "indextable.h"
+#include "compressedids.h"
+#include "file.h"
+#include "tempdir.h"
+#include <vector>
+#include <string>
+
+using namespace std;
+
+
+#define TRIGRAM(a, b, c)	((uint32_t) (a) << 16 | (b) << 8 | (c))
+
+struct RunList
+{
+	uint32_t trigram;
+	vector<uint32_t> ids;
+};
+
+/* Stores lists (sorted by trigram, with absolute IDs) as single chunk of
+ * temporary index, the way DbWriter does, one sorted run per partition */
+static void writeRun(File &idxFile, File &dataFile, uint32_t flags,
+		vector<SortedRuns> &partitions, const vector<RunList> &lists)
+{
+	vector<SortedRun> runs(partitions.size());
+	for (SortedRun &run : runs)
+		run.indexesNo = 0;
+
+	for (const RunList &list : lists)
+	{
+		CompressedIds ids;
+		for (uint32_t id : list.ids)
+			ids.add(id);
+
+		vector<uint8_t> data(ids.getData(), ids.getData() + ids.size());
+		if (flags & INDEX_BLOCK_LISTS)
+			CompressedIds::toBlocks(ids.getData(), ids.size(), data);
+
+		RunIndex index;
+		index.trigram = list.trigram;
+		index.firstId = list.ids.front();
+		index.lastId = list.ids.back();
+		index.offset = dataFile.tell();
+		index.size = data.size();
+		index.complement = false;
+
+		SortedRun &run = runs[trigramPartition(index.trigram)];
+		if (run.indexesNo == 0)
+		{
+			run.indexOffset = idxFile.tell() / sizeof(RunIndex);
+			run.dataOffset = index.offset;
+			run.dataSize = 0;
+		}
+
+		run.indexesNo++;
+		run.dataSize += index.size;
+
+		idxFile.writeObj(index);
+		dataFile.write(data.data(), data.size());
+	}
+
+	for (unsigned partition = 0; partition < runs.size(); partition++)
+	{
+		if (runs[partition].indexesNo > 0)
+			partitions[partition].push_back(runs[partition]);
+	}
+}
+
+static void addToTable(TrigramTable &table, uint32_t baseId,
+		const vector<RunList> &lists)
+{
+	for (const RunList &list : lists)
+	{
+		for (uint32_t id : list.ids)
+			table.add(list.trigram, id - baseId);
+	}
+}
+
+class SortedDb
+{
+	public:
+		SortedDb(const string &idxPath, const string &dataPath)
+		{
+			m_table.read(idxPath);
+			readFile(m_data, dataPath.c_str());
+		}
+
+		const IndexTable &table() const
+		{
+			return m_table;
+		}
+
+		CompressedIds get(uint32_t trigram) const
+		{
+			Index index;
+			REQUIRE( m_table.find(trigram, index) );
+			REQUIRE( !index.complement );
+			REQUIRE( index.offset + index.size <= m_data.size() );
+
+			CompressedIds ids;
+			ids.setView(m_data.data() + index.offset, index.size, index.lastId,
+					m_table.flags() & INDEX_BLOCK_LISTS ?
+					CompressedIds::BLOCKS : CompressedIds::VARINT);
+			return ids;
+		}
+
+	private:
+		IndexTable m_table;
+		vector<uint8_t> m_data;
+};
+
+/* Two spilled chunks with IDs 0-99 and 100-299 and in-memory chunk from 300.
+ * IDs are large enough to make absolute heads of lists longer than the
+ * relative ones, so the heads must be re-encoded when merged. */
+static void sortChunks(const TempDir &dir, uint32_t flags, TrigramTable &table,
+		const vector<RunList> &extra, unsigned threadsNo)
+{
+	File idxFile(dir.path("chunks.index"), "w+b");
+	File dataFile(dir.path("chunks.data"), "w+b");
+	vector<SortedRuns> partitions(partitionsNo(flags));
+
+	writeRun(idxFile, dataFile, flags, partitions, {
+			{ TRIGRAM('a', 'b', 'c'), IDS(0, 1, 2, 80, 99) },
+			{ TRIGRAM('a', 'b', 'd'), IDS(5) },
+			{ TRIGRAM('x', 'y', 'z'), IDS(70, 90) },
+		});
+
+	writeRun(idxFile, dataFile, flags, partitions, {
+			{ TRIGRAM('a', 'b', 'c'), IDS(100, 101, 102, 103, 104, 290) },
+			{ TRIGRAM('m', 'm', 'm'), IDS(150) },
+			{ TRIGRAM('x', 'y', 'z'), IDS(200) },
+		});
+
+	idxFile.flush();
+	dataFile.flush();
+
+	vector<RunList> lists = {
+			{ TRIGRAM('a', 'b', 'c'), IDS(300, 301, 400) },
+			{ TRIGRAM('m', 'm', 'm'), IDS(500) },
+			{ TRIGRAM('q', 'q', 'q'), IDS(310, 320) },
+		};
+
+	lists.insert(lists.end(), extra.begin(), extra.end());
+	addToTable(table, 300, lists);
+
+	sortDatabase(flags, 0, 600, 50, partitions, { { &table, 300 } },
+			dir.path("chunks.index"), dir.path("chunks.data"),
+			dir.path("index"), dir.path("data"), 1024 * 1024, threadsNo);
+}
+
+static void checkLists(const SortedDb &db)
+{
+	REQUIRE( db.table().firstId() == 0 );
+	REQUIRE( db.table().endId() == 600 );
+	REQUIRE( db.table().stopGrams() == 50 );
+
+	REQUIRE( CMP_IDS(db.get(TRIGRAM('a', 'b', 'c')), 0, 1, 2, 80, 99, 100,
+				101, 102, 103, 104, 290, 300, 301, 400) );
+	REQUIRE( CMP_IDS(db.get(TRIGRAM('a', 'b', 'd')), 5) );
+	REQUIRE( CMP_IDS(db.get(TRIGRAM('m', 'm', 'm')), 150, 500) );
+	REQUIRE( CMP_IDS(db.get(TRIGRAM('q', 'q', 'q')), 310, 320) );
+	REQUIRE( CMP_IDS(db.get(TRIGRAM('x', 'y', 'z')), 70, 90, 200) );
+}
+
+TEST_CASE("Merging sorted runs", "[SortDb]")
+{
+	TempDir dir;
+	TrigramTable table;
+
+	SECTION("Varint lists", "[SortDb]")
+	{
+		sortChunks(dir, 0, table, {}, 4);
+
+		SortedDb db(dir.path("index"), dir.path("data"));
+		REQUIRE( db.table().flags() == INDEX_SPARSE_BUCKETS );
+		REQUIRE( db.table().size() == 5 );
+		checkLists(db);
+	}
+
+	SECTION("Block lists", "[SortDb]")
+	{
+		// long list is encoded in several blocks
+		RunList list = { TRIGRAM('b', 'b', 'b'), {} };
+		for (uint32_t id = 300; id < 600; id += 2)
+			list.ids.push_back(id);
+
+		sortChunks(dir, INDEX_BLOCK_LISTS, table, { list }, 1);
+
+		SortedDb db(dir.path("index"), dir.path("data"));
+		REQUIRE( db.table().flags() ==
+				(INDEX_BLOCK_LISTS | INDEX_SPARSE_BUCKETS) );
+		checkLists(db);
+		REQUIRE( compareIds(db.get(list.trigram), list.ids) );
+	}
+
+	SECTION("Dense bucket table", "[SortDb]")
+	{
+		// partitions are written by parallel writers when too many buckets
+		// are used for sparse table
+		vector<RunList> lists;
+		for (uint32_t bucket = 0x100; bucket < 0x100 + INDEX_BUCKETS_NO / 4;
+				bucket++)
+		{
+			lists.push_back({ bucket << 8, IDS(300 + bucket % 200) });
+		}
+
+		sortChunks(dir, 0, table, lists, 4);
+
+		SortedDb db(dir.path("index"), dir.path("data"));
+		REQUIRE( db.table().flags() == 0 );
+		REQUIRE( db.table().size() == 5 + lists.size() );
+		checkLists(db);
+
+		for (const RunList &list : lists)
+			REQUIRE( compareIds(db.get(list.trigram), list.ids) );
+	}
+}
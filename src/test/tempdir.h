@@ -0,0 +1,33 @@
+#ifndef __TEST_TEMP_DIR_H__
+#define __TEST_TEMP_DIR_H__
+
+#include <string>
+#include <boost/filesystem.hpp>
+
+
+/* Unique directory, removed with its content when test ends */
+class TempDir
+{
+	public:
+		TempDir() : m_path(boost::filesystem::temp_directory_path() /
+				boost::filesystem::unique_path("grip-test-%%%%-%%%%-%%%%"))
+		{
+			boost::filesystem::create_directories(m_path);
+		}
+
+		~TempDir()
+		{
+			boost::system::error_code ec;
+			boost::filesystem::remove_all(m_path, ec);
+		}
+
+		std::string path(const std::string &name = std::string()) const
+		{
+			return name.empty() ? m_path.string() : (m_path / name).string();
+		}
+
+	private:
+		boost::filesystem::path m_path;
+};
+
+#endif
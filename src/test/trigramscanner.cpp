@@ -0,0 +1,104 @@
+#include "catch2/catch.hpp"
+#include "../gripgen/trigramscanner.h"
+#include <vector>
+#include <set>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+
+// reference implementation, byte after byte
+static set<uint32_t> scanTrigrams(const vector<uint8_t> &data)
+{
+	set<uint32_t> res;
+	uint32_t trigram = '\n';
+
+	for (uint8_t ch : data)
+	{
+		if (ch == '\r')
+			continue;
+
+		trigram = (trigram << 8) | ch;
+		if (trigram & 0xff0000)
+			res.insert(trigram & 0xffffff);
+
+		if (ch == '\n')
+			trigram = '\n';
+	}
+
+	if (trigram & 0xff00)
+		res.insert(((trigram << 8) | '\n') & 0xffffff);
+
+	return res;
+}
+
+static set<uint32_t> scanTrigrams(const vector<uint8_t> &data, size_t fragment,
+		bool &binary)
+{
+	TrigramScanner scanner;
+	vector<uint32_t> out(data.size());
+	set<uint32_t> res;
+
+	binary = false;
+	for (size_t pos = 0; pos < data.size(); pos += fragment)
+	{
+		size_t len = min(fragment, data.size() - pos);
+		binary |= !scanner.scan(data.data() + pos, len, out.data() + pos);
+	}
+
+	for (uint32_t trigram : out)
+	{
+		if (trigram != 0)
+			res.insert(trigram);
+	}
+
+	uint32_t trigram;
+	if (scanner.finish(trigram))
+		res.insert(trigram);
+
+	return res;
+}
+
+TEST_CASE("Trigram scanner", "[TrigramScanner]")
+{
+	SECTION("Scanning text", "[TrigramScanner]")
+	{
+		const char *alphabets[] = { "abcdefgh ", "ab\n", "a\r\n", "xy\r\n\n" };
+		srand(1);
+
+		for (const char *alphabet : alphabets)
+		{
+			size_t alphabetSize = strlen(alphabet);
+
+			for (size_t size : { 3, 16, 33, 100, 1000, 5000 })
+			{
+				vector<uint8_t> data;
+				for (size_t i = 0; i < size; i++)
+					data.push_back(alphabet[rand() % alphabetSize]);
+
+				set<uint32_t> expected = scanTrigrams(data);
+
+				for (size_t fragment : { 7, 64, 4096 })
+				{
+					bool binary;
+					REQUIRE( scanTrigrams(data, fragment, binary) == expected );
+					REQUIRE( !binary );
+				}
+			}
+		}
+	}
+
+	SECTION("Detecting binary files", "[TrigramScanner]")
+	{
+		for (size_t pos : { 0, 1, 15, 16, 31, 32, 100, 999 })
+		{
+			vector<uint8_t> data(1000, 'a');
+			data[pos] = '\0';
+
+			bool binary;
+			scanTrigrams(data, 4096, binary);
+			REQUIRE( binary );
+		}
+	}
+}
@@ -0,0 +1,167 @@
+#include "catch2/catch.hpp"
+#include "../gripgen/trigramtable.h"
+#include "ids.h"
+#include "index.h"
+#include "compressedids.h"
+#include "error.h"
+#include <vector>
+#include <map>
+#include <random>
+
+using namespace std;
+
+
+#define TRIGRAM(a, b, c)	((uint32_t) (a) << 16 | (b) << 8 | (c))
+
+typedef map<uint32_t, vector<uint32_t>> Lists;
+
+/* Adds IDs of lists interleaved, the way indexer adds them file by file */
+static void addLists(TrigramTable &table, const Lists &lists)
+{
+	size_t pos = 0;
+	bool added = true;
+
+	while (added)
+	{
+		added = false;
+		for (const Lists::value_type &list : lists)
+		{
+			if (pos < list.second.size())
+			{
+				table.add(list.first, list.second[pos]);
+				added = true;
+			}
+		}
+
+		pos++;
+	}
+}
+
+static void checkTable(const TrigramTable &table, const Lists &lists)
+{
+	REQUIRE( table.trigramsNo() == lists.size() );
+	REQUIRE( table.empty() == lists.empty() );
+
+	Lists::const_iterator expected = lists.begin();
+	vector<uint8_t> data;
+
+	for (TrigramTable::iterator it = table.begin(); !it.end(); ++it)
+	{
+		REQUIRE( expected != lists.end() );
+		REQUIRE( it.trigram() == expected->first );
+		REQUIRE( it.firstId() == expected->second.front() );
+		REQUIRE( it.lastId() == expected->second.back() );
+
+		data.resize(it.size());
+		it.copyData(data.data());
+
+		CompressedIds ids;
+		ids.setView(data.data(), data.size(), it.lastId());
+		REQUIRE( compareIds(ids, expected->second) );
+
+		++expected;
+	}
+
+	REQUIRE( expected == lists.end() );
+}
+
+/* Lists of trigrams scattered over pages (and case-folded ones), long lists
+ * span many blocks, some of them with repeated deltas */
+static Lists makeLists(mt19937 &rnd, size_t trigramsNo, uint32_t maxId)
+{
+	Lists lists;
+	uniform_int_distribution<uint32_t> trigram(0, 0x1ffffff);
+	uniform_int_distribution<uint32_t> length(1, 100);
+	uniform_int_distribution<uint32_t> delta(1, 1000);
+
+	while (lists.size() < trigramsNo)
+	{
+		uint32_t tri = trigram(rnd);
+		if (lists.count(tri))
+			continue;
+
+		vector<uint32_t> &ids = lists[tri];
+		uint32_t step = length(rnd) % 3 == 0 ? delta(rnd) : 0;
+		for (uint32_t id = (delta(rnd) - 1) % maxId, no = length(rnd);
+				no > 0 && id < maxId; id += step ? step : delta(rnd), no--)
+		{
+			ids.push_back(id);
+		}
+	}
+
+	return lists;
+}
+
+TEST_CASE("Trigram table", "[TrigramTable]")
+{
+	TrigramTable table;
+
+	SECTION("Adding IDs", "[TrigramTable]")
+	{
+		REQUIRE( table.empty() );
+		REQUIRE( table.begin().end() );
+		REQUIRE( table.memoryUsage() == TrigramTable::fixedMemoryUsage() );
+
+		// first ID is encoded relatively to zero, the next ones as deltas
+		// with repetitions
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'c'), 200) == 2 );
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'c'), 201) == 1 );
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'c'), 202) == 1 );
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'c'), 203) == 0 );
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'c'), 203) == 0 );
+		REQUIRE( table.add(TRIGRAM('x', 'y', 'z'), 0) == 1 );
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'd'), 5) == 1 );
+		REQUIRE( table.add(TRIGRAM('a', 'b', 'd') | TRIGRAM_FOLDED, 5) == 1 );
+		REQUIRE_THROWS_AS( table.add(TRIGRAM('a', 'b', 'c'), 100), Error );
+
+		REQUIRE( table.memoryUsage() > TrigramTable::fixedMemoryUsage() );
+
+		checkTable(table, {
+				{ TRIGRAM('a', 'b', 'c'), IDS(200, 201, 202, 203) },
+				{ TRIGRAM('a', 'b', 'd'), IDS(5) },
+				{ TRIGRAM('x', 'y', 'z'), IDS(0) },
+				{ TRIGRAM('a', 'b', 'd') | TRIGRAM_FOLDED, IDS(5) },
+			});
+
+		REQUIRE( table.lowerBound(TRIGRAM('a', 'b', 'd')).trigram() ==
+				TRIGRAM('a', 'b', 'd') );
+		REQUIRE( table.lowerBound(TRIGRAM('a', 'b', 'e')).trigram() ==
+				TRIGRAM('x', 'y', 'z') );
+		REQUIRE( table.lowerBound(TRIGRAM('b', 0, 0)).trigram() ==
+				TRIGRAM('x', 'y', 'z') );
+		REQUIRE( table.lowerBound(TRIGRAM('x', 'y', 'z') + 1).trigram() ==
+				(TRIGRAM('a', 'b', 'd') | TRIGRAM_FOLDED) );
+		REQUIRE( table.lowerBound(TRIGRAM_FOLDED | 0xffffff).end() );
+	}
+
+	SECTION("Indexing several chunks", "[TrigramTable]")
+	{
+		// the first chunk takes more than a single slab of blocks, following
+		// ones reuse them
+		mt19937 rnd(1);
+		vector<Lists> chunks = {
+			makeLists(rnd, 60000, 100000),
+			makeLists(rnd, 10, 100),
+			makeLists(rnd, 5000, 1000000),
+		};
+
+		for (const Lists &lists : chunks)
+		{
+			addLists(table, lists);
+			checkTable(table, lists);
+
+			table.clear();
+			REQUIRE( table.empty() );
+			REQUIRE( table.trigramsNo() == 0 );
+			REQUIRE( table.begin().end() );
+			REQUIRE( table.lowerBound(0).end() );
+			REQUIRE( table.memoryUsage() == TrigramTable::fixedMemoryUsage() );
+		}
+
+		table.releaseMemory();
+		REQUIRE( table.empty() );
+
+		addLists(table, chunks[1]);
+		checkTable(table, chunks[1]);
+	}
+}